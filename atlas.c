@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+#include "canvas.h"
+#include "mem.h"
+#include "pgm.h"
+
+
+int atlas_open(struct atlas_writer* writer, const char* base_filename, size_t width) {
+    if (writer == NULL || base_filename == NULL || width < ATLAS_MIN_WIDTH) {
+        return -1;
+    }
+
+    memset(writer, 0x00, sizeof(struct atlas_writer));
+    writer->base_filename = base_filename;
+    writer->width = width;
+    writer->height = width;
+
+    /* "<base>_page<number>.pgm" */
+    writer->filename = mem_alloc(strlen(base_filename) + 30);
+    writer->page = mem_calloc(writer->width * writer->height, 1);
+    /* A shelf is at least a row high, padding included. */
+    writer->shelves_max = writer->height / (1 + ATLAS_PADDING) + 1;
+    writer->shelves = mem_alloc(writer->shelves_max * sizeof(struct atlas_shelf));
+    if (writer->filename == NULL || writer->page == NULL || writer->shelves == NULL) {
+        perror("atlas_open(): malloc()");
+        atlas_close(writer);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+const char* atlas_page_filename(struct atlas_writer* writer, size_t page_num) {
+    sprintf(writer->filename, "%s_page%04lu.pgm", writer->base_filename, page_num);
+    return writer->filename;
+}
+
+
+/**
+ * Writes the current page, as high as its shelves go, and starts the next
+ * one.
+ */
+static int atlas_flush(struct atlas_writer* writer) {
+    const struct atlas_shelf* last;
+    size_t height;
+    FILE* page_file;
+    int result;
+
+    if (writer->shelves_cnt == 0) {
+        return 0;
+    }
+
+    last = &(writer->shelves[writer->shelves_cnt - 1]);
+    height = last->y + last->height + ATLAS_PADDING;
+
+    if ((page_file = fopen(atlas_page_filename(writer, writer->page_num), "wb")) == NULL) {
+        perror("atlas_flush(): fopen()");
+        return -1;
+    }
+    result = pgm_write(page_file, writer->page, writer->width, height);
+    fclose(page_file);
+
+    memset(writer->page, 0x00, writer->width * height);
+    writer->shelves_cnt = 0;
+    writer->page_num++;
+    writer->pages_cnt += !result;
+
+    return result;
+}
+
+
+/**
+ * Finds room for a width by height caption on the current page: on the
+ * lowest shelf it fits on, on the last shelf grown taller, or on a new
+ * shelf.  Returns NULL if the page is full.
+ */
+static struct atlas_shelf* atlas_find_shelf(struct atlas_writer* writer, size_t width, size_t height) {
+    struct atlas_shelf* best = NULL;
+    struct atlas_shelf* shelf;
+    struct atlas_shelf* last = NULL;
+    size_t i, y;
+
+    for (i = 0; i < writer->shelves_cnt; i++) {
+        shelf = &(writer->shelves[i]);
+        if (shelf->height >= height && shelf->x + width + ATLAS_PADDING <= writer->width &&
+            (best == NULL || shelf->height < best->height)) {
+            best = shelf;
+        }
+    }
+    if (best != NULL) {
+        return best;
+    }
+
+    if (writer->shelves_cnt > 0) {
+        last = &(writer->shelves[writer->shelves_cnt - 1]);
+        if (last->x + width + ATLAS_PADDING <= writer->width &&
+            last->y + height + ATLAS_PADDING <= writer->height) {
+            last->height = height;
+            return last;
+        }
+    }
+
+    y = last != NULL ? last->y + last->height + ATLAS_PADDING : ATLAS_PADDING;
+    if (y + height + ATLAS_PADDING > writer->height || writer->shelves_cnt == writer->shelves_max) {
+        return NULL;
+    }
+
+    shelf = &(writer->shelves[writer->shelves_cnt++]);
+    shelf->y = y;
+    shelf->height = height;
+    shelf->x = ATLAS_PADDING;
+    return shelf;
+}
+
+
+/**
+ * Packs the caption's visible pixels onto a page.  Returns -1 if it's
+ * blank or too large for a page.
+ */
+int atlas_add(struct atlas_writer* writer, const struct canvas* canvas, struct atlas_rect* rect) {
+    struct atlas_shelf* shelf;
+    size_t x0, y0, x1, y1, y;
+
+    if (canvas_visible_bounds(canvas, &x0, &y0, &x1, &y1)) {
+        return -1;
+    }
+
+    rect->width = x1 - x0;
+    rect->height = y1 - y0;
+    rect->screen_x = x0;
+    rect->screen_y = y0;
+    if (rect->width + 2 * ATLAS_PADDING > writer->width ||
+        rect->height + 2 * ATLAS_PADDING > writer->height) {
+        fprintf(stderr, "A %lux%lu caption doesn't fit on a %lux%lu page.\n",
+                rect->width, rect->height, writer->width, writer->height);
+        return -1;
+    }
+
+    if ((shelf = atlas_find_shelf(writer, rect->width, rect->height)) == NULL) {
+        if (atlas_flush(writer)) {
+            return -1;
+        }
+        shelf = atlas_find_shelf(writer, rect->width, rect->height);
+    }
+
+    rect->page_num = writer->page_num;
+    rect->x = shelf->x;
+    rect->y = shelf->y;
+    shelf->x += rect->width + ATLAS_PADDING;
+
+    for (y = 0; y < rect->height; y++) {
+        canvas_copy_span(canvas, y0 + y, x0, x1,
+                         writer->page + (rect->y + y) * writer->width + rect->x);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Writes the last page.
+ */
+int atlas_close(struct atlas_writer* writer) {
+    int result = 0;
+
+    if (writer->page != NULL && atlas_flush(writer)) {
+        fprintf(stderr, "Failed writing %s.\n", atlas_page_filename(writer, writer->page_num - 1));
+        result = -1;
+    }
+
+    free(writer->filename);
+    free(writer->page);
+    free(writer->shelves);
+    writer->filename = NULL;
+    writer->page = NULL;
+    writer->shelves = NULL;
+
+    return result;
+}
@@ -0,0 +1,63 @@
+#ifndef SUP2PGM_ATLAS_H
+#define SUP2PGM_ATLAS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "canvas.h"
+
+/* Space left around each caption and along the page edges. */
+#define ATLAS_PADDING 8
+#define ATLAS_MIN_WIDTH 256
+
+
+struct atlas_shelf {
+    size_t y;
+    size_t height;
+    size_t x;       /* Where the next caption goes */
+};
+
+
+/**
+ * Where a caption went: its rectangle on a page, and where it was on the
+ * screen.
+ */
+struct atlas_rect {
+    size_t page_num;
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+    size_t screen_x;
+    size_t screen_y;
+};
+
+
+/**
+ * Page atlas for batched OCR: captions cropped to their visible pixels are
+ * packed onto width by width pages on shelves, best fitting shelf first.
+ * A page is written once the next caption doesn't fit, cut down to the
+ * height in use.
+ */
+struct atlas_writer {
+    const char* base_filename;
+    char* filename;
+    size_t width;
+    size_t height;
+
+    unsigned char* page;
+    size_t page_num;
+    size_t pages_cnt;     /* Written */
+
+    struct atlas_shelf* shelves;
+    size_t shelves_cnt;
+    size_t shelves_max;
+};
+
+
+int atlas_open(struct atlas_writer* writer, const char* base_filename, size_t width);
+int atlas_add(struct atlas_writer* writer, const struct canvas* canvas, struct atlas_rect* rect);
+const char* atlas_page_filename(struct atlas_writer* writer, size_t page_num);
+int atlas_close(struct atlas_writer* writer);
+
+#endif  /* SUP2PGM_ATLAS_H */
@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "mem.h"
+
+#define CACHE_HASH_PRIME 0x9e3779b97f4a7c15ULL
+
+/* "0123456789abcdef.pgm" */
+#define CACHE_ENTRY_NAME_LEN 20
+
+
+struct cache_entry {
+    time_t mtime;
+    long mtime_ns;
+    off_t size;
+    char name[CACHE_ENTRY_NAME_LEN + 1];
+};
+
+
+static uint64_t cache_mix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+
+/**
+ * Adds data to the hash, eight bytes at a time.
+ */
+uint64_t cache_hash(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* p = data;
+    uint64_t k;
+
+    for (; len >= 8; p += 8, len -= 8) {
+        memcpy(&k, p, 8);
+        hash = (hash ^ cache_mix(k)) * CACHE_HASH_PRIME;
+    }
+
+    k = len;
+    memcpy(&k, p, len);
+    return cache_mix((hash ^ cache_mix(k ^ ((uint64_t) len << 56))) * CACHE_HASH_PRIME);
+}
+
+
+static const char* cache_entry_path(struct render_cache* cache, uint64_t key) {
+    sprintf(cache->path, "%s/%016llx.pgm", cache->dir, (unsigned long long) key);
+    return cache->path;
+}
+
+
+static int cache_entry_cmp(const void* a, const void* b) {
+    const struct cache_entry* ea = a;
+    const struct cache_entry* eb = b;
+
+    if (ea->mtime != eb->mtime) {
+        return ea->mtime < eb->mtime ? -1 : 1;
+    }
+    return ea->mtime_ns < eb->mtime_ns ? -1 : ea->mtime_ns > eb->mtime_ns;
+}
+
+
+/**
+ * Sums up the entries' sizes, evicting the least recently used ones down
+ * to the low watermark if asked to.
+ */
+static int cache_scan(struct render_cache* cache, int evict) {
+    struct cache_entry* entries = NULL;
+    struct cache_entry* new_entries;
+    size_t entries_cnt = 0, entries_max = 0, i;
+    unsigned long long size = 0,
+                       low = cache->max_size / 100 * CACHE_EVICT_PERCENT;
+    struct dirent* dirent;
+    struct stat st;
+    DIR* dir;
+
+    if ((dir = opendir(cache->dir)) == NULL) {
+        perror("cache_scan(): opendir()");
+        return -1;
+    }
+
+    while ((dirent = readdir(dir)) != NULL) {
+        if (strlen(dirent->d_name) != CACHE_ENTRY_NAME_LEN ||
+            strcmp(dirent->d_name + CACHE_ENTRY_NAME_LEN - 4, ".pgm")) {
+            continue;
+        }
+
+        sprintf(cache->path, "%s/%s", cache->dir, dirent->d_name);
+        if (stat(cache->path, &st) || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        size += st.st_size;
+
+        if (!evict) {
+            continue;
+        }
+
+        if (entries_cnt == entries_max) {
+            entries_max = entries_max > 0 ? entries_max * 2 : 256;
+            if ((new_entries = mem_realloc(entries, entries_max * sizeof(struct cache_entry))) == NULL) {
+                perror("cache_scan(): realloc()");
+                break;
+            }
+            entries = new_entries;
+        }
+        entries[entries_cnt].mtime = st.st_mtim.tv_sec;
+        entries[entries_cnt].mtime_ns = st.st_mtim.tv_nsec;
+        entries[entries_cnt].size = st.st_size;
+        strcpy(entries[entries_cnt].name, dirent->d_name);
+        entries_cnt++;
+    }
+    closedir(dir);
+
+    if (evict) {
+        qsort(entries, entries_cnt, sizeof(struct cache_entry), cache_entry_cmp);
+        for (i = 0; i < entries_cnt && size > low; i++) {
+            sprintf(cache->path, "%s/%s", cache->dir, entries[i].name);
+            if (!unlink(cache->path)) {
+                size -= entries[i].size;
+                cache->evicted++;
+            }
+        }
+        free(entries);
+    }
+
+    cache->size = size;
+    return 0;
+}
+
+
+int cache_open(struct render_cache* cache, const char* dir, unsigned long long max_size) {
+    if (cache == NULL || dir == NULL) {
+        return -1;
+    }
+
+    memset(cache, 0x00, sizeof(struct render_cache));
+    cache->max_size = max_size;
+
+    if (mkdir(dir, 0777) && errno != EEXIST) {
+        perror("cache_open(): mkdir()");
+        return -1;
+    }
+
+    cache->dir = mem_alloc(strlen(dir) + 1);
+    cache->path = mem_alloc(strlen(dir) + CACHE_ENTRY_NAME_LEN + 2);
+    if (cache->dir == NULL || cache->path == NULL) {
+        perror("cache_open(): malloc()");
+        cache_close(cache);
+        return -1;
+    }
+    strcpy(cache->dir, dir);
+
+    /* Sized up first, trimmed only if it's over already. */
+    if (cache_scan(cache, 0) ||
+        (cache->size > cache->max_size && cache_scan(cache, 1))) {
+        cache_close(cache);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Tells whether there's an entry for the key, marking it as recently used.
+ */
+int cache_lookup(struct render_cache* cache, uint64_t key) {
+    if (utimensat(AT_FDCWD, cache_entry_path(cache, key), NULL, 0)) {
+        cache->misses++;
+        return -1;
+    }
+
+    cache->hits++;
+    return 0;
+}
+
+
+static int cache_copy(const char* src, const char* dest) {
+    char buf[65536];
+    ssize_t n;
+    int src_fd, dest_fd, result = 0;
+
+    if ((src_fd = open(src, O_RDONLY)) < 0) {
+        perror("cache_copy(): open()");
+        return -1;
+    }
+    if ((dest_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+        perror("cache_copy(): open()");
+        close(src_fd);
+        return -1;
+    }
+
+    while ((n = read(src_fd, buf, sizeof(buf))) > 0) {
+        if (write(dest_fd, buf, n) != n) {
+            perror("cache_copy(): write()");
+            result = -1;
+            break;
+        }
+    }
+    if (n < 0) {
+        perror("cache_copy(): read()");
+        result = -1;
+    }
+
+    close(src_fd);
+    close(dest_fd);
+    return result;
+}
+
+
+/**
+ * Makes filename the cached image, copying it only if it can't be linked.
+ */
+int cache_link(struct render_cache* cache, uint64_t key, const char* filename) {
+    const char* path = cache_entry_path(cache, key);
+
+    if (unlink(filename) && errno != ENOENT) {
+        perror("cache_link(): unlink()");
+        return -1;
+    }
+
+    if (link(path, filename)) {
+        if (errno != EXDEV) {
+            perror("cache_link(): link()");
+            return -1;
+        }
+        return cache_copy(path, filename);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Adds the just written image as the entry for the key.
+ */
+int cache_insert(struct render_cache* cache, uint64_t key, const char* filename) {
+    const char* path = cache_entry_path(cache, key);
+    struct stat st;
+
+    if (link(filename, path)) {
+        /* Somebody else was faster, or it's another file system: no cache. */
+        return errno == EEXIST ? 0 : -1;
+    }
+
+    if (!stat(path, &st)) {
+        cache->size += st.st_size;
+    }
+    if (cache->size > cache->max_size) {
+        return cache_scan(cache, 1);
+    }
+
+    return 0;
+}
+
+
+void cache_close(struct render_cache* cache) {
+    free(cache->dir);
+    free(cache->path);
+
+    cache->dir = NULL;
+    cache->path = NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef SUP2PGM_CACHE_H
+#define SUP2PGM_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CACHE_DEFAULT_SIZE_MB 1024
+
+/* Bump whenever rendering changes, old entries are then never hit. */
+#define CACHE_FORMAT "sup2pgm-cache-2"
+
+/* Evict down to this share of the maximum size at once. */
+#define CACHE_EVICT_PERCENT 90
+
+
+/**
+ * On-disk cache of rendered captions: PGM files named after the hash of
+ * whatever went into rendering them.  Entries are hard links, inserting
+ * and reusing them copies no data.  Least recently used entries (by
+ * mtime) are evicted once the cache grows past its size.
+ */
+struct render_cache {
+    char* dir;
+    char* path;  /* Entry file name buffer */
+    unsigned long long max_size;
+    unsigned long long size;
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evicted;
+};
+
+
+uint64_t cache_hash(uint64_t hash, const void* data, size_t len);
+
+int cache_open(struct render_cache* cache, const char* dir, unsigned long long max_size);
+int cache_lookup(struct render_cache* cache, uint64_t key);
+int cache_link(struct render_cache* cache, uint64_t key, const char* filename);
+int cache_insert(struct render_cache* cache, uint64_t key, const char* filename);
+void cache_close(struct render_cache* cache);
+
+#endif  /* SUP2PGM_CACHE_H */
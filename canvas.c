@@ -0,0 +1,444 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canvas.h"
+#include "mem.h"
+#include "pgm.h"
+
+
+void canvas_init(struct canvas* canvas) {
+    memset(canvas, 0x00, sizeof(struct canvas));
+}
+
+
+void canvas_free(struct canvas* canvas) {
+    size_t i;
+
+    canvas_clear(canvas);
+    for (i = 0; i < canvas->spare_cnt; i++) {
+        free(canvas->spare[i]);
+    }
+
+    free(canvas->tiles);
+    free(canvas->live);
+    free(canvas->spare);
+    free(canvas->row);
+
+    canvas_init(canvas);
+}
+
+
+int canvas_resize(struct canvas* canvas, size_t width, size_t height) {
+    size_t tiles_x = (width + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE,
+           tiles_y = (height + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+
+    canvas_free(canvas);
+
+    canvas->width = width;
+    canvas->height = height;
+    canvas->tiles_x = tiles_x;
+    canvas->tiles_y = tiles_y;
+
+    if (tiles_x * tiles_y == 0) {
+        return 0;
+    }
+
+    canvas->tiles = mem_calloc(tiles_x * tiles_y, sizeof(unsigned char*));
+    canvas->live = mem_alloc(tiles_x * tiles_y * sizeof(size_t));
+    canvas->spare = mem_alloc(tiles_x * tiles_y * sizeof(unsigned char*));
+    canvas->row = mem_alloc(width);
+    if (canvas->tiles == NULL || canvas->live == NULL ||
+        canvas->spare == NULL || canvas->row == NULL) {
+        perror("canvas_resize(): malloc()");
+        canvas_free(canvas);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void canvas_clear(struct canvas* canvas) {
+    size_t i, idx;
+
+    for (i = 0; i < canvas->live_cnt; i++) {
+        idx = canvas->live[i];
+        canvas->spare[canvas->spare_cnt++] = canvas->tiles[idx];
+        canvas->tiles[idx] = NULL;
+    }
+    canvas->live_cnt = 0;
+}
+
+
+/* Returns the tile at idx, taking a blank one if there's none yet. */
+static unsigned char* canvas_take_tile(struct canvas* canvas, size_t idx) {
+    unsigned char* tile = canvas->tiles[idx];
+
+    if (tile != NULL) {
+        return tile;
+    }
+
+    if (canvas->spare_cnt > 0) {
+        tile = canvas->spare[--canvas->spare_cnt];
+    } else if ((tile = mem_alloc(CANVAS_TILE_LEN)) == NULL) {
+        perror("canvas_take_tile(): malloc()");
+        return NULL;
+    }
+
+    memset(tile, 0x00, CANVAS_TILE_LEN);
+    canvas->tiles[idx] = tile;
+    canvas->live[canvas->live_cnt++] = idx;
+
+    return tile;
+}
+
+
+void canvas_clear_region(struct canvas* canvas,
+                         size_t region_width, size_t region_height,
+                         size_t region_x, size_t region_y) {
+    size_t i, x0, x1, y, y0, y1, idx;
+    unsigned char* tile;
+
+    if (region_x >= canvas->width || region_y >= canvas->height) {
+        return;
+    }
+    if (region_width > canvas->width - region_x) {
+        region_width = canvas->width - region_x;
+    }
+    if (region_height > canvas->height - region_y) {
+        region_height = canvas->height - region_y;
+    }
+
+    /* Blank tiles are clear already, only go through the live ones. */
+    for (i = 0; i < canvas->live_cnt; i++) {
+        idx = canvas->live[i];
+        tile = canvas->tiles[idx];
+
+        x0 = (idx % canvas->tiles_x) * CANVAS_TILE_SIZE;
+        y0 = (idx / canvas->tiles_x) * CANVAS_TILE_SIZE;
+        x1 = x0 + CANVAS_TILE_SIZE;
+        y1 = y0 + CANVAS_TILE_SIZE;
+
+        /* Intersect the tile with the region. */
+        if (x0 < region_x) {
+            x0 = region_x;
+        }
+        if (x1 > region_x + region_width) {
+            x1 = region_x + region_width;
+        }
+        if (y0 < region_y) {
+            y0 = region_y;
+        }
+        if (y1 > region_y + region_height) {
+            y1 = region_y + region_height;
+        }
+
+        for (y = y0; x0 < x1 && y < y1; y++) {
+            memset(tile + (y % CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE + x0 % CANVAS_TILE_SIZE,
+                   0x00, x1 - x0);
+        }
+    }
+}
+
+
+/**
+ * Sets n pixels starting at (x, y), wrapping to the following rows.
+ * x may be past the end of the row.
+ */
+int canvas_fill(struct canvas* canvas, size_t x, size_t y, unsigned char value, size_t n) {
+    size_t chunk, idx;
+    unsigned char* tile;
+
+    while (x >= canvas->width && canvas->width > 0) {
+        x -= canvas->width;
+        y++;
+    }
+
+    while (n > 0 && y < canvas->height) {
+        chunk = CANVAS_TILE_SIZE - x % CANVAS_TILE_SIZE;
+        if (chunk > canvas->width - x) {
+            chunk = canvas->width - x;
+        }
+        if (chunk > n) {
+            chunk = n;
+        }
+
+        idx = (y / CANVAS_TILE_SIZE) * canvas->tiles_x + x / CANVAS_TILE_SIZE;
+        if (value != 0x00) {
+            if ((tile = canvas_take_tile(canvas, idx)) == NULL) {
+                return -1;
+            }
+        } else {
+            /* Zeroes only matter on top of something. */
+            tile = canvas->tiles[idx];
+        }
+        if (tile != NULL) {
+            memset(tile + (y % CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE + x % CANVAS_TILE_SIZE,
+                   value, chunk);
+        }
+
+        n -= chunk;
+        x += chunk;
+        if (x == canvas->width) {
+            x = 0;
+            y++;
+        }
+    }
+
+    return 0;
+}
+
+
+unsigned char canvas_max_gray(const struct canvas* canvas) {
+    size_t i, j;
+    const unsigned char* tile;
+    unsigned char max_gray = 0x00;
+
+    /* Tile padding past the canvas edges is never drawn on, so it's zero. */
+    for (i = 0; i < canvas->live_cnt; i++) {
+        tile = canvas->tiles[canvas->live[i]];
+        for (j = 0; j < CANVAS_TILE_LEN; j++) {
+            if (tile[j] > max_gray) {
+                max_gray = tile[j];
+            }
+        }
+    }
+
+    return max_gray;
+}
+
+
+/**
+ * Finds the area covered by live tiles, [x0, x1) by [y0, y1).  Returns -1
+ * if the canvas is blank.
+ */
+int canvas_bounds(const struct canvas* canvas, size_t* x0, size_t* y0, size_t* x1, size_t* y1) {
+    size_t i, tx, ty,
+           tx0 = canvas->tiles_x, ty0 = canvas->tiles_y,
+           tx1 = 0, ty1 = 0;
+
+    if (canvas->live_cnt == 0) {
+        return -1;
+    }
+
+    for (i = 0; i < canvas->live_cnt; i++) {
+        tx = canvas->live[i] % canvas->tiles_x;
+        ty = canvas->live[i] / canvas->tiles_x;
+        if (tx < tx0) {
+            tx0 = tx;
+        }
+        if (tx >= tx1) {
+            tx1 = tx + 1;
+        }
+        if (ty < ty0) {
+            ty0 = ty;
+        }
+        if (ty >= ty1) {
+            ty1 = ty + 1;
+        }
+    }
+
+    *x0 = tx0 * CANVAS_TILE_SIZE;
+    *y0 = ty0 * CANVAS_TILE_SIZE;
+    *x1 = tx1 * CANVAS_TILE_SIZE < canvas->width ? tx1 * CANVAS_TILE_SIZE : canvas->width;
+    *y1 = ty1 * CANVAS_TILE_SIZE < canvas->height ? ty1 * CANVAS_TILE_SIZE : canvas->height;
+
+    return 0;
+}
+
+
+/**
+ * Finds the area of the visible pixels, [x0, x1) by [y0, y1).  Returns -1
+ * if there are none.
+ */
+int canvas_visible_bounds(const struct canvas* canvas, size_t* x0, size_t* y0, size_t* x1, size_t* y1) {
+    size_t i, idx, tx, ty, x, y;
+    const unsigned char* tile;
+
+    *x0 = canvas->width;
+    *y0 = canvas->height;
+    *x1 = 0;
+    *y1 = 0;
+
+    /* Tile padding past the canvas edges is never drawn on, so it's zero. */
+    for (i = 0; i < canvas->live_cnt; i++) {
+        idx = canvas->live[i];
+        tile = canvas->tiles[idx];
+        tx = (idx % canvas->tiles_x) * CANVAS_TILE_SIZE;
+        ty = (idx / canvas->tiles_x) * CANVAS_TILE_SIZE;
+
+        for (y = 0; y < CANVAS_TILE_SIZE; y++) {
+            for (x = 0; x < CANVAS_TILE_SIZE; x++) {
+                if (tile[y * CANVAS_TILE_SIZE + x] != 0x00) {
+                    *x0 = tx + x < *x0 ? tx + x : *x0;
+                    *x1 = tx + x + 1 > *x1 ? tx + x + 1 : *x1;
+                    *y0 = ty + y < *y0 ? ty + y : *y0;
+                    *y1 = ty + y + 1 > *y1 ? ty + y + 1 : *y1;
+                }
+            }
+        }
+    }
+
+    return *x1 > *x0 ? 0 : -1;
+}
+
+
+/**
+ * Makes dest a copy of src, resized to match if it isn't already.
+ */
+int canvas_assign(struct canvas* dest, const struct canvas* src) {
+    size_t i, idx;
+    unsigned char* tile;
+
+    if (dest->width != src->width || dest->height != src->height) {
+        if (canvas_resize(dest, src->width, src->height)) {
+            return -1;
+        }
+    } else {
+        canvas_clear(dest);
+    }
+
+    for (i = 0; i < src->live_cnt; i++) {
+        idx = src->live[i];
+        if ((tile = canvas_take_tile(dest, idx)) == NULL) {
+            return -1;
+        }
+        memcpy(tile, src->tiles[idx], CANVAS_TILE_LEN);
+    }
+
+    return 0;
+}
+
+
+/* Grows [x0, x1) by [y0, y1) by the pixels that differ in a tile, NULL is blank. */
+static void canvas_diff_tile(const unsigned char* a, const unsigned char* b, size_t idx, size_t tiles_x,
+                             size_t* x0, size_t* y0, size_t* x1, size_t* y1) {
+    static const unsigned char blank[CANVAS_TILE_SIZE];
+    const unsigned char* row_a;
+    const unsigned char* row_b;
+    size_t tx = (idx % tiles_x) * CANVAS_TILE_SIZE,
+           ty = (idx / tiles_x) * CANVAS_TILE_SIZE,
+           i, j;
+
+    for (j = 0; j < CANVAS_TILE_SIZE; j++) {
+        row_a = a != NULL ? a + j * CANVAS_TILE_SIZE : blank;
+        row_b = b != NULL ? b + j * CANVAS_TILE_SIZE : blank;
+        if (!memcmp(row_a, row_b, CANVAS_TILE_SIZE)) {
+            continue;
+        }
+
+        for (i = 0; i < CANVAS_TILE_SIZE; i++) {
+            if (row_a[i] != row_b[i]) {
+                *x0 = tx + i < *x0 ? tx + i : *x0;
+                *x1 = tx + i + 1 > *x1 ? tx + i + 1 : *x1;
+                *y0 = ty + j < *y0 ? ty + j : *y0;
+                *y1 = ty + j + 1 > *y1 ? ty + j + 1 : *y1;
+            }
+        }
+    }
+}
+
+
+/**
+ * Finds the area where two canvases of the same size differ, [x0, x1) by
+ * [y0, y1).  Only tiles live in either one are looked at.  Returns -1 if
+ * they're the same.
+ */
+int canvas_diff(const struct canvas* a, const struct canvas* b,
+                size_t* x0, size_t* y0, size_t* x1, size_t* y1) {
+    size_t i, idx;
+
+    *x0 = a->width;
+    *y0 = a->height;
+    *x1 = 0;
+    *y1 = 0;
+
+    for (i = 0; i < a->live_cnt; i++) {
+        idx = a->live[i];
+        if (b->tiles[idx] == NULL || memcmp(a->tiles[idx], b->tiles[idx], CANVAS_TILE_LEN)) {
+            canvas_diff_tile(a->tiles[idx], b->tiles[idx], idx, a->tiles_x, x0, y0, x1, y1);
+        }
+    }
+    for (i = 0; i < b->live_cnt; i++) {
+        idx = b->live[i];
+        if (a->tiles[idx] == NULL) {
+            canvas_diff_tile(NULL, b->tiles[idx], idx, b->tiles_x, x0, y0, x1, y1);
+        }
+    }
+
+    return *x1 > *x0 ? 0 : -1;
+}
+
+
+/* Copies pixels [x0, x1) of a canvas row into dest, which starts at x0. */
+void canvas_copy_span(const struct canvas* canvas, size_t y, size_t x0, size_t x1, unsigned char* dest) {
+    size_t x, len;
+    const unsigned char* tile;
+
+    for (x = x0; x < x1; x += len) {
+        len = CANVAS_TILE_SIZE - x % CANVAS_TILE_SIZE;
+        if (len > x1 - x) {
+            len = x1 - x;
+        }
+
+        tile = canvas->tiles[(y / CANVAS_TILE_SIZE) * canvas->tiles_x + x / CANVAS_TILE_SIZE];
+        if (tile == NULL) {
+            memset(dest + x - x0, 0x00, len);
+        } else {
+            memcpy(dest + x - x0,
+                   tile + (y % CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE + x % CANVAS_TILE_SIZE,
+                   len);
+        }
+    }
+}
+
+
+/* Copies one canvas row into a dense buffer. */
+static void canvas_copy_row(const struct canvas* canvas, size_t y, unsigned char* dest) {
+    size_t tx, x, len;
+    const unsigned char* tile;
+
+    for (tx = 0; tx < canvas->tiles_x; tx++) {
+        x = tx * CANVAS_TILE_SIZE;
+        len = canvas->width - x < CANVAS_TILE_SIZE ? canvas->width - x : CANVAS_TILE_SIZE;
+
+        tile = canvas->tiles[(y / CANVAS_TILE_SIZE) * canvas->tiles_x + tx];
+        if (tile == NULL) {
+            memset(dest + x, 0x00, len);
+        } else {
+            memcpy(dest + x, tile + (y % CANVAS_TILE_SIZE) * CANVAS_TILE_SIZE, len);
+        }
+    }
+}
+
+
+void canvas_copy(const struct canvas* canvas, unsigned char* dest) {
+    size_t y;
+
+    for (y = 0; y < canvas->height; y++) {
+        canvas_copy_row(canvas, y, dest + y * canvas->width);
+    }
+}
+
+
+int canvas_write_pgm(FILE* fd, const struct canvas* canvas) {
+    size_t y;
+    unsigned char max_gray = canvas_max_gray(canvas);
+
+    if (max_gray == 0x00) {
+        return -1;
+    }
+
+    pgm_write_header(fd, canvas->width, canvas->height, max_gray);
+    for (y = 0; y < canvas->height; y++) {
+        canvas_copy_row(canvas, y, canvas->row);
+        if (fwrite(canvas->row, canvas->width, 1, fd) != 1) {
+            perror("canvas_write_pgm()");
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef SUP2PGM_CANVAS_H
+#define SUP2PGM_CANVAS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define CANVAS_TILE_SIZE 64
+#define CANVAS_TILE_LEN (CANVAS_TILE_SIZE * CANVAS_TILE_SIZE)
+
+
+/**
+ * Sparse 8-bit canvas made of square tiles.  Tiles are only taken (and
+ * cleared) when something visible is drawn on them, a missing tile reads
+ * as all zeroes.  Cleared tiles go to a spare list for reuse, so memory
+ * follows the largest caption area rather than the screen size.
+ */
+struct canvas {
+    size_t width;
+    size_t height;
+    size_t tiles_x;
+    size_t tiles_y;
+
+    unsigned char** tiles;  /* tiles_x * tiles_y, row by row; NULL is blank */
+
+    size_t* live;           /* Indices of the tiles in use */
+    size_t live_cnt;
+
+    unsigned char** spare;  /* Blank tiles ready for reuse */
+    size_t spare_cnt;
+
+    unsigned char* row;     /* Scratch row for writing */
+};
+
+
+void canvas_init(struct canvas* canvas);
+int canvas_resize(struct canvas* canvas, size_t width, size_t height);
+void canvas_free(struct canvas* canvas);
+
+void canvas_clear(struct canvas* canvas);
+void canvas_clear_region(struct canvas* canvas,
+                         size_t region_width, size_t region_height,
+                         size_t region_x, size_t region_y);
+
+int canvas_fill(struct canvas* canvas, size_t x, size_t y, unsigned char value, size_t n);
+
+unsigned char canvas_max_gray(const struct canvas* canvas);
+int canvas_bounds(const struct canvas* canvas, size_t* x0, size_t* y0, size_t* x1, size_t* y1);
+int canvas_visible_bounds(const struct canvas* canvas, size_t* x0, size_t* y0, size_t* x1, size_t* y1);
+int canvas_assign(struct canvas* dest, const struct canvas* src);
+int canvas_diff(const struct canvas* a, const struct canvas* b,
+                size_t* x0, size_t* y0, size_t* x1, size_t* y1);
+void canvas_copy_span(const struct canvas* canvas, size_t y, size_t x0, size_t x1, unsigned char* dest);
+void canvas_copy(const struct canvas* canvas, unsigned char* dest);
+int canvas_write_pgm(FILE* fd, const struct canvas* canvas);
+
+#endif  /* SUP2PGM_CANVAS_H */
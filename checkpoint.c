@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+
+/**
+ * Writes the checkpoint to a temporary file first, then renames it over
+ * the old one, so a checkpoint is either the old one or the new one.
+ */
+int checkpoint_write(const char* filename, const struct checkpoint* ckpt) {
+    char* tmp_filename;
+    FILE* fd;
+    int result = -1;
+
+    if ((tmp_filename = malloc(strlen(filename) + 5)) == NULL) {
+        perror("checkpoint_write(): malloc()");
+        return -1;
+    }
+    sprintf(tmp_filename, "%s.tmp", filename);
+
+    if ((fd = fopen(tmp_filename, "w")) == NULL) {
+        perror("checkpoint_write(): fopen()");
+        free(tmp_filename);
+        return -1;
+    }
+
+    fprintf(fd, "%s %d\n", CHECKPOINT_MAGIC, CHECKPOINT_VERSION);
+    fprintf(fd, "offset %lld\n", (long long) ckpt->offset);
+    fprintf(fd, "image %lu\n", (unsigned long) ckpt->pgm_file_num);
+    fprintf(fd, "start %lu\n", (unsigned long) ckpt->srt_start_time);
+    fprintf(fd, "srtx %lld\n", (long long) ckpt->srt_len);
+
+    if (fflush(fd) || fsync(fileno(fd))) {
+        perror("checkpoint_write(): fsync()");
+    } else if (rename(tmp_filename, filename)) {
+        perror("checkpoint_write(): rename()");
+    } else {
+        result = 0;
+    }
+
+    fclose(fd);
+    if (result) {
+        unlink(tmp_filename);
+    }
+    free(tmp_filename);
+
+    return result;
+}
+
+
+/**
+ * Returns 1 if there's no checkpoint yet.
+ */
+int checkpoint_read(const char* filename, struct checkpoint* ckpt) {
+    FILE* fd;
+    int version = 0;
+    long long offset, srt_len;
+    unsigned long pgm_file_num, srt_start_time;
+    int result = -1;
+
+    if ((fd = fopen(filename, "r")) == NULL) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        perror("checkpoint_read(): fopen()");
+        return -1;
+    }
+
+    if (fscanf(fd, CHECKPOINT_MAGIC " %d", &version) != 1 || version != CHECKPOINT_VERSION) {
+        fprintf(stderr, "Unknown checkpoint format in %s.\n", filename);
+    } else if (fscanf(fd, " offset %lld image %lu start %lu srtx %lld",
+                      &offset, &pgm_file_num, &srt_start_time, &srt_len) != 4 ||
+               offset < 0 || srt_len < 0) {
+        fprintf(stderr, "Bad checkpoint in %s.\n", filename);
+    } else {
+        ckpt->offset = offset;
+        ckpt->pgm_file_num = pgm_file_num;
+        ckpt->srt_start_time = srt_start_time;
+        ckpt->srt_len = srt_len;
+        result = 0;
+    }
+
+    fclose(fd);
+    return result;
+}
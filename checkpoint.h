@@ -0,0 +1,30 @@
+#ifndef SUP2PGM_CHECKPOINT_H
+#define SUP2PGM_CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define CHECKPOINT_MAGIC "sup2pgm-checkpoint"
+#define CHECKPOINT_VERSION 1
+
+/* Don't rewrite the checkpoint file more often than that. */
+#define CHECKPOINT_INTERVAL_MS 1000
+
+
+/**
+ * Conversion state at the start of an epoch: nothing before it is needed
+ * to render what follows, so the conversion can restart from there.
+ */
+struct checkpoint {
+    off_t offset;             /* Of the epoch start PCS in the input */
+    size_t pgm_file_num;      /* Next image number */
+    uint32_t srt_start_time;  /* Merge timing */
+    off_t srt_len;            /* Of the .srtx written so far */
+};
+
+
+int checkpoint_write(const char* filename, const struct checkpoint* ckpt);
+int checkpoint_read(const char* filename, struct checkpoint* ckpt);
+
+#endif  /* SUP2PGM_CHECKPOINT_H */
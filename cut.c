@@ -0,0 +1,384 @@
+/* copy_file_range() */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cut.h"
+#include "mem.h"
+#include "sup.h"
+
+
+/**
+ * Parses "[[HH:]MM:]SS[.mmm]" into ms, setting end past it.
+ */
+int cut_parse_time(const char* str, char** end, uint32_t* ms) {
+    unsigned long long total = 0;
+    unsigned long field, frac = 0, scale = 100;
+    const char* p = str;
+    char* q;
+    size_t n;
+
+    for (n = 0; n < 3; n++) {
+        if (!isdigit((unsigned char) *p) || (field = strtoul(p, &q, 10)) > UINT32_MAX) {
+            return -1;
+        }
+        total = total * 60 + field;
+        p = q;
+        if (*p != ':') {
+            break;
+        }
+        p++;
+    }
+    if (n == 3) {
+        return -1;
+    }
+
+    if (*p == '.') {
+        p++;
+        if (!isdigit((unsigned char) *p)) {
+            return -1;
+        }
+        for (; isdigit((unsigned char) *p); p++) {
+            frac += (*p - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    total = total * 1000 + frac;
+    if (total > UINT32_MAX) {
+        return -1;
+    }
+
+    *ms = total;
+    if (end != NULL) {
+        *end = (char*) p;
+    }
+    return 0;
+}
+
+
+int cut_open(struct sup_cutter* cutter, int fd, const uint32_t* points, size_t points_cnt,
+             uint8_t rebase) {
+    struct stat st;
+    size_t i;
+
+    if (cutter == NULL || fd < 0 || points_cnt > CUT_MAX_POINTS) {
+        return -1;
+    }
+    for (i = 1; i < points_cnt; i++) {
+        if (points[i] <= points[i - 1]) {
+            fprintf(stderr, "Cut points should be in ascending order.\n");
+            return -1;
+        }
+    }
+
+    if (fstat(fd, &st)) {
+        perror("cut_open(): fstat()");
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Only SUP files can be cut, not pipes.\n");
+        return -1;
+    }
+
+    memset(cutter, 0x00, sizeof(struct sup_cutter));
+    cutter->fd = fd;
+    cutter->len = st.st_size;
+    cutter->rebase = rebase;
+    cutter->copy_method = CUT_COPY_RANGE;
+    memcpy(cutter->points, points, points_cnt * sizeof(uint32_t));
+    cutter->points_cnt = points_cnt;
+
+    if ((cutter->window = mem_alloc(CUT_WINDOW_LEN)) == NULL) {
+        perror("cut_open(): malloc()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Points buf at the input from offset on, reading the window there if
+ * CUT_PEEK_LEN bytes aren't in it already.  Returns how many bytes, up to
+ * CUT_PEEK_LEN, there are (0 at EOF), -1 on errors.
+ *
+ * Headers coming one right after another double the read, up to the
+ * window.  One past segment data that was never read is likely behind a
+ * large object, whose data isn't wanted either: only the rest of its page
+ * is read, the kernel reads no less anyway.
+ */
+static ssize_t cut_peek(struct sup_cutter* cutter, off_t offset, const unsigned char** buf) {
+    off_t window_end = cutter->window_offset + (off_t) cutter->window_len;
+    ssize_t n;
+
+    if (offset < cutter->window_offset || offset + CUT_PEEK_LEN > window_end) {
+        if (cutter->window_len > 0 && offset >= cutter->window_offset && offset <= window_end) {
+            cutter->read_len = cutter->read_len < CUT_WINDOW_LEN / 2 ? cutter->read_len * 2 : CUT_WINDOW_LEN;
+        } else {
+            cutter->read_len = CUT_PAGE_LEN - offset % CUT_PAGE_LEN;
+        }
+        if (cutter->read_len < CUT_PEEK_LEN) {
+            cutter->read_len += CUT_PAGE_LEN;
+        }
+
+        do {
+            n = pread(cutter->fd, cutter->window, cutter->read_len, offset);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            perror("cut_peek(): pread()");
+            return -1;
+        }
+        cutter->window_offset = offset;
+        cutter->window_len = n;
+    }
+
+    *buf = cutter->window + (offset - cutter->window_offset);
+    n = cutter->window_offset + cutter->window_len - offset;
+    return n < CUT_PEEK_LEN ? n : CUT_PEEK_LEN;
+}
+
+
+/**
+ * Walks the packet headers, finding where each part starts.  A packet cut
+ * short at the end of the file is left out.
+ */
+int cut_scan(struct sup_cutter* cutter) {
+    struct sup_packet packet;
+    const unsigned char* buf;
+    off_t offset = 0, next;
+    size_t i = 0;
+    ssize_t n;
+
+    cutter->packets = 0;
+    cutter->epochs = 0;
+
+    while ((n = cut_peek(cutter, offset, &buf)) > 0) {
+        if (n < SUP_PACKET_HEADER_LEN) {
+            fprintf(stderr, "Truncated packet at %lld, leaving it out.\n", (long long) offset);
+            break;
+        }
+        if (sup_parse_packet_header(buf, &packet)) {
+            fprintf(stderr, "Bad packet at %lld.\n", (long long) offset);
+            return -1;
+        }
+        next = offset + SUP_PACKET_HEADER_LEN + packet.segment_len;
+        if (next > cutter->len) {
+            fprintf(stderr, "Truncated packet at %lld, leaving it out.\n", (long long) offset);
+            break;
+        }
+
+        if (cutter->packets == 0) {
+            cutter->parts[0].pts = packet.pts;
+            cutter->parts[0].base = packet.pts;
+        }
+        cutter->packets++;
+
+        if (packet.segment_type == SUP_SEGMENT_PCS && n == CUT_PEEK_LEN &&
+            buf[CUT_PEEK_LEN - 1] == SUP_PCS_STATE_EPOCH_START) {
+            cutter->epochs++;
+            for (; i < cutter->points_cnt && packet.pts / SUP_PTS_FREQ >= cutter->points[i]; i++) {
+                cutter->parts[i].end = offset;
+                cutter->parts[i + 1].start = offset;
+                cutter->parts[i + 1].pts = packet.pts;
+                cutter->parts[i + 1].base = packet.pts;
+            }
+        }
+
+        /**
+         * Decoding may start ahead of the epoch start's PTS.
+         * A DTS of zero means there's none.
+         */
+        if (packet.pts < cutter->parts[i].base) {
+            cutter->parts[i].base = packet.pts;
+        }
+        if (packet.dts != 0 && packet.dts < cutter->parts[i].base) {
+            cutter->parts[i].base = packet.dts;
+        }
+
+        offset = next;
+    }
+    if (n < 0) {
+        return -1;
+    }
+
+    /* Points past the last epoch start leave empty parts at the end. */
+    for (; i < cutter->points_cnt; i++) {
+        cutter->parts[i].end = offset;
+        cutter->parts[i + 1].start = offset;
+    }
+    cutter->parts[i].end = offset;
+
+    return 0;
+}
+
+
+/**
+ * Copies len bytes of the input from offset on to the end of out, by the
+ * first means that works between the two files.
+ */
+static int cut_copy(struct sup_cutter* cutter, off_t offset, int out, size_t len) {
+    ssize_t n, done, written;
+
+    while (len > 0) {
+        if (cutter->copy_method == CUT_COPY_RANGE) {
+            n = copy_file_range(cutter->fd, &offset, out, NULL, len, 0);
+            if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                cutter->copy_method = CUT_SENDFILE;
+                continue;
+            }
+        } else if (cutter->copy_method == CUT_SENDFILE) {
+            n = sendfile(out, cutter->fd, &offset, len);
+            if (n < 0 && (errno == ENOSYS || errno == EINVAL)) {
+                cutter->copy_method = CUT_READ_WRITE;
+                continue;
+            }
+        } else {
+            /* The window is read again on the next peek. */
+            cutter->window_len = 0;
+            n = pread(cutter->fd, cutter->window, len < CUT_WINDOW_LEN ? len : CUT_WINDOW_LEN, offset);
+            for (done = 0; n > 0 && done < n; done += written) {
+                if ((written = write(out, cutter->window + done, n - done)) < 0) {
+                    if (errno != EINTR) {
+                        perror("cut_copy(): write()");
+                        return -1;
+                    }
+                    written = 0;
+                }
+            }
+            if (n > 0) {
+                offset += n;
+            }
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("cut_copy()");
+            return -1;
+        } else if (n == 0) {
+            fprintf(stderr, "Unexpected EOF.\n");
+            return -1;
+        }
+        len -= n;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Shifts the timestamps of the packets copied to out by the part's base,
+ * so the earliest one is zero and the rest keep their distances.  A DTS of
+ * zero means there's none and stays so.
+ */
+static int cut_rebase(struct sup_cutter* cutter, const struct cut_part* part, int out) {
+    struct sup_packet packet;
+    unsigned char header[SUP_PACKET_HEADER_LEN];
+    const unsigned char* buf;
+    off_t offset;
+    ssize_t n;
+
+    for (offset = part->start; offset < part->end;
+         offset += SUP_PACKET_HEADER_LEN + packet.segment_len) {
+        if (cut_peek(cutter, offset, &buf) < SUP_PACKET_HEADER_LEN ||
+            sup_parse_packet_header(buf, &packet)) {
+            return -1;
+        }
+
+        packet.pts -= part->base;
+        if (packet.dts != 0) {
+            packet.dts -= part->base;
+        }
+        sup_serialize_packet_header(&packet, header);
+
+        /* Only PTS and DTS, right after the marker. */
+        do {
+            n = pwrite(out, header + 2, 8, offset - part->start + 2);
+        } while (n < 0 && errno == EINTR);
+        if (n != 8) {
+            perror("cut_rebase(): pwrite()");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Writes part part_num (0 to points_cnt) to filename.  Writing a part
+ * over the input is refused.
+ */
+int cut_write_part(struct sup_cutter* cutter, size_t part_num, const char* filename) {
+    const struct cut_part* part;
+    struct stat in_st, out_st;
+    int out, result = 0;
+
+    if (part_num > cutter->points_cnt) {
+        return -1;
+    }
+    part = &(cutter->parts[part_num]);
+
+    if ((out = open(filename, O_WRONLY | O_CREAT, 0644)) < 0) {
+        perror("cut_write_part(): open()");
+        return -1;
+    }
+    if (fstat(cutter->fd, &in_st) || fstat(out, &out_st)) {
+        perror("cut_write_part(): fstat()");
+        close(out);
+        return -1;
+    }
+    if (in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+        fprintf(stderr, "%s is the input file.\n", filename);
+        close(out);
+        return -1;
+    }
+
+    if (ftruncate(out, 0)) {
+        perror("cut_write_part(): ftruncate()");
+        result = -1;
+    } else if (cut_copy(cutter, part->start, out, part->end - part->start) ||
+               (cutter->rebase && cut_rebase(cutter, part, out))) {
+        result = -1;
+    } else {
+        cutter->bytes_out += part->end - part->start;
+    }
+
+    if (close(out)) {
+        perror("cut_write_part(): close()");
+        result = -1;
+    }
+
+    return result;
+}
+
+
+const char* cut_copy_method_name(int copy_method) {
+    switch (copy_method) {
+    case CUT_COPY_RANGE:
+        return "copy_file_range";
+    case CUT_SENDFILE:
+        return "sendfile";
+    default:
+        return "read/write";
+    }
+}
+
+
+void cut_close(struct sup_cutter* cutter) {
+    free(cutter->window);
+    cutter->window = NULL;
+}
@@ -0,0 +1,74 @@
+#ifndef SUP2PGM_CUT_H
+#define SUP2PGM_CUT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "sup.h"
+
+#define CUT_MAX_POINTS 256
+
+/* Most input read at a time while walking packet headers. */
+#define CUT_WINDOW_LEN (64 * 1024)
+
+/* Reads past a large segment go up to the end of the page. */
+#define CUT_PAGE_LEN 4096
+
+/* Packet header and the PCS fields up to the composition state. */
+#define CUT_PEEK_LEN (SUP_PACKET_HEADER_LEN + 8)
+
+#define CUT_COPY_RANGE 0   /* copy_file_range(), may share extents */
+#define CUT_SENDFILE 1     /* sendfile() */
+#define CUT_READ_WRITE 2   /* Plain pread() and write(), data goes through the window */
+
+
+/**
+ * Byte range of the input going into one output file.  Parts start at an
+ * epoch start, so each one decodes on its own.
+ */
+struct cut_part {
+    off_t start;
+    off_t end;
+    uint32_t pts;   /* Of its first packet */
+    uint32_t base;  /* Smallest PTS or DTS in it, zero once rebased */
+};
+
+
+/**
+ * Packet-level SUP cutter.  The input is walked header to header, segment
+ * data is never looked at except for the PCS composition state, and each
+ * cut point is moved forward to the first epoch start at or after it.
+ * Parts are copied file to file by the kernel, PTS and DTS optionally
+ * rebased to start at zero by patching the copied headers in place.
+ */
+struct sup_cutter {
+    int fd;
+    off_t len;
+    uint8_t rebase;
+    int copy_method;
+
+    uint32_t points[CUT_MAX_POINTS];  /* ms, ascending */
+    size_t points_cnt;
+    struct cut_part parts[CUT_MAX_POINTS + 1];
+
+    unsigned char* window;
+    off_t window_offset;
+    size_t window_len;
+    size_t read_len;  /* Of the last read into the window */
+
+    size_t packets;
+    size_t epochs;
+    unsigned long long bytes_out;
+};
+
+
+int cut_parse_time(const char* str, char** end, uint32_t* ms);
+
+int cut_open(struct sup_cutter* cutter, int fd, const uint32_t* points, size_t points_cnt,
+             uint8_t rebase);
+int cut_scan(struct sup_cutter* cutter);
+int cut_write_part(struct sup_cutter* cutter, size_t part_num, const char* filename);
+const char* cut_copy_method_name(int copy_method);
+void cut_close(struct sup_cutter* cutter);
+
+#endif  /* SUP2PGM_CUT_H */
@@ -0,0 +1,174 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "mem.h"
+#include "sup.h"
+
+/* Slack for aligning every piece carved out of the arena. */
+#define DECODER_ARENA_SLACK 256
+
+
+int decoder_init(struct sup_decoder* dec) {
+    size_t arena_size;
+
+    if (dec == NULL) {
+        return -1;
+    }
+
+    memset(dec, 0x00, sizeof(struct sup_decoder));
+
+    arena_size = sizeof(struct sup_packet) + SUP_PACKET_MAX_SEGMENT_LEN +
+                 sizeof(struct sup_segment_pcs) + DECODER_MAX_ENTRIES * sizeof(struct sup_object) +
+                 sizeof(struct sup_segment_pds) + DECODER_MAX_ENTRIES * sizeof(struct sup_color) +
+                 sizeof(struct sup_segment_wds) + DECODER_MAX_ENTRIES * sizeof(struct sup_window) +
+                 sizeof(struct sup_segment_ods) +
+                 DECODER_MAX_OBJECTS * sizeof(struct subimage) +
+                 DECODER_ARENA_SLACK;
+    if (arena_init(&(dec->arena), arena_size)) {
+        return -1;
+    }
+
+    dec->packet = arena_alloc(&(dec->arena), sizeof(struct sup_packet));
+    dec->pcs = arena_alloc(&(dec->arena), sizeof(struct sup_segment_pcs));
+    dec->pds = arena_alloc(&(dec->arena), sizeof(struct sup_segment_pds));
+    dec->wds = arena_alloc(&(dec->arena), sizeof(struct sup_segment_wds));
+    dec->ods = arena_alloc(&(dec->arena), sizeof(struct sup_segment_ods));
+    dec->subimgs = arena_alloc(&(dec->arena), DECODER_MAX_OBJECTS * sizeof(struct subimage));
+    if (dec->packet == NULL || dec->pcs == NULL || dec->pds == NULL ||
+        dec->wds == NULL || dec->ods == NULL || dec->subimgs == NULL) {
+        decoder_free(dec);
+        return -1;
+    }
+
+    /* With the tables in place the sup_init_*() calls don't allocate. */
+    dec->packet->segment = arena_alloc(&(dec->arena), SUP_PACKET_MAX_SEGMENT_LEN);
+    dec->pcs->objects = arena_alloc(&(dec->arena), DECODER_MAX_ENTRIES * sizeof(struct sup_object));
+    dec->pds->colors = arena_alloc(&(dec->arena), DECODER_MAX_ENTRIES * sizeof(struct sup_color));
+    dec->wds->windows = arena_alloc(&(dec->arena), DECODER_MAX_ENTRIES * sizeof(struct sup_window));
+    if (dec->packet->segment == NULL || dec->pcs->objects == NULL ||
+        dec->pds->colors == NULL || dec->wds->windows == NULL) {
+        decoder_free(dec);
+        return -1;
+    }
+
+    memset(dec->subimgs, 0x00, DECODER_MAX_OBJECTS * sizeof(struct subimage));
+    dec->subimgs_cnt = 0;
+
+    if (sup_init_packet(dec->packet)) {
+        decoder_free(dec);
+        return -1;
+    }
+    decoder_reset_composition(dec);
+
+    return 0;
+}
+
+
+void decoder_free(struct sup_decoder* dec) {
+    size_t i;
+
+    if (dec == NULL) {
+        return;
+    }
+
+    if (dec->subimgs != NULL) {
+        for (i = 0; i < DECODER_MAX_OBJECTS; i++) {
+            free(dec->subimgs[i].img);
+        }
+    }
+
+    arena_free(&(dec->arena));
+
+    dec->packet = NULL;
+    dec->pcs = NULL;
+    dec->pds = NULL;
+    dec->wds = NULL;
+    dec->ods = NULL;
+    dec->subimgs = NULL;
+    dec->subimgs_cnt = 0;
+}
+
+
+void decoder_reset_composition(struct sup_decoder* dec) {
+    sup_init_segment_pcs(dec->pcs);
+    sup_init_segment_pds(dec->pds);
+    sup_init_segment_wds(dec->wds);
+    sup_init_segment_ods(dec->ods);
+}
+
+
+void decoder_reset_objects(struct sup_decoder* dec) {
+    /* Keep the buffers around for the next epoch's objects. */
+    dec->subimgs_cnt = 0;
+}
+
+
+struct subimage* decoder_find_object(const struct sup_decoder* dec, uint16_t obj_id) {
+    size_t i;
+
+    for (i = 0; i < dec->subimgs_cnt; i++) {
+        if (dec->subimgs[i].obj_id == obj_id) {
+            return &(dec->subimgs[i]);
+        }
+    }
+
+    return NULL;
+}
+
+
+int decoder_add_ods(struct sup_decoder* dec, const struct sup_segment_ods* ods) {
+    struct subimage* subimg;
+    unsigned char* img;
+    size_t len;
+
+    subimg = decoder_find_object(dec, ods->obj_id);
+    if (subimg == NULL) {
+        if (dec->subimgs_cnt == DECODER_MAX_OBJECTS) {
+            fprintf(stderr, "Too many objects in epoch.\n");
+            return -1;
+        }
+
+        subimg = &(dec->subimgs[dec->subimgs_cnt++]);
+        subimg->obj_id = ods->obj_id;
+        subimg->len = 0;
+    }
+
+    len = subimg->len;
+    if (ods->obj_flag & SUP_ODS_FIRST) {
+        subimg->len = 0;
+        subimg->obj_version = ods->obj_version;
+        subimg->width = ods->obj_width;
+        subimg->height = ods->obj_height;
+
+        /* Presize the buffer for the whole object (data length includes its size). */
+        len = ods->obj_data_len > 4 ? ods->obj_data_len - 4 : 0;
+    }
+    if (len < subimg->len + ods->raw_data_len) {
+        len = subimg->len + ods->raw_data_len;
+    }
+
+    if (len > subimg->max_len) {
+        /* Grow geometrically so that slightly larger objects don't realloc every time. */
+        if (len < 2 * subimg->max_len) {
+            len = 2 * subimg->max_len;
+        }
+        if (len < SUP_PACKET_MAX_SEGMENT_LEN) {
+            len = SUP_PACKET_MAX_SEGMENT_LEN;
+        }
+
+        if ((img = mem_realloc(subimg->img, len)) == NULL) {
+            perror("decoder_add_ods(): realloc()");
+            return -1;
+        }
+        subimg->img = img;
+        subimg->max_len = len;
+    }
+
+    memcpy(subimg->img + subimg->len, ods->raw_data, ods->raw_data_len);
+    subimg->len += ods->raw_data_len;
+
+    return 0;
+}
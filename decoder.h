@@ -0,0 +1,60 @@
+#ifndef SUP2PGM_DECODER_H
+#define SUP2PGM_DECODER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mem.h"
+#include "sup.h"
+
+
+/* PGS allows up to 64 objects to be defined per epoch. */
+#define DECODER_MAX_OBJECTS 64
+
+/* Table sizes for the 8-bit counters in PCS, PDS and WDS. */
+#define DECODER_MAX_ENTRIES 0x100
+
+
+/**
+ * Reassembled object (RLE data) from one or more ODS fragments.
+ */
+struct subimage {
+    uint16_t obj_id;
+    uint8_t obj_version;
+    uint16_t width;
+    uint16_t height;
+    size_t max_len;
+    size_t len;
+    unsigned char* img;
+};
+
+
+/**
+ * Decoder state: packet and segment placeholders live in a single arena,
+ * objects in a fixed-size table whose buffers only ever grow, so no heap
+ * allocations happen once the largest object of the stream has been seen.
+ */
+struct sup_decoder {
+    struct arena arena;
+
+    struct sup_packet* packet;
+    struct sup_segment_pcs* pcs;
+    struct sup_segment_pds* pds;
+    struct sup_segment_wds* wds;
+    struct sup_segment_ods* ods;
+
+    size_t subimgs_cnt;
+    struct subimage* subimgs;
+};
+
+
+int decoder_init(struct sup_decoder* dec);
+void decoder_free(struct sup_decoder* dec);
+
+void decoder_reset_composition(struct sup_decoder* dec);
+void decoder_reset_objects(struct sup_decoder* dec);
+
+struct subimage* decoder_find_object(const struct sup_decoder* dec, uint16_t obj_id);
+int decoder_add_ods(struct sup_decoder* dec, const struct sup_segment_ods* ods);
+
+#endif  /* SUP2PGM_DECODER_H */
@@ -0,0 +1,531 @@
+/* fopencookie() */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#ifdef SUP2PGM_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef SUP2PGM_WITH_LZMA
+#include <lzma.h>
+#endif
+#ifdef SUP2PGM_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "decompress.h"
+#include "mem.h"
+#include "sup.h"
+
+#define DECOMPRESS_MAGIC_LEN 6
+
+
+/**
+ * Decompression runs on a thread of its own, filling two blocks in turn
+ * while the reader empties the other one.  A block belongs to the thread
+ * while it isn't full, to the reader while it is.
+ */
+struct decompressor {
+    FILE* src;
+    int format;
+
+    /* Decompression thread's. */
+    unsigned char magic[DECOMPRESS_MAGIC_LEN];  /* Already read off src */
+    size_t magic_len;
+    unsigned char* in;
+    size_t in_pos;
+    size_t in_len;
+    uint8_t eof;    /* Of src */
+    uint8_t ended;  /* At the end of a stream (gzip member, zstd frame) */
+
+#ifdef SUP2PGM_WITH_ZLIB
+    z_stream gzip;
+#endif
+#ifdef SUP2PGM_WITH_LZMA
+    lzma_stream xz;
+#endif
+#ifdef SUP2PGM_WITH_ZSTD
+    ZSTD_DStream* zstd;
+#endif
+
+    pthread_t thread;
+    uint8_t started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned char* blocks[2];
+    size_t lens[2];
+    uint8_t full[2];
+    uint8_t done;      /* No more blocks coming */
+    uint8_t failed;
+    uint8_t stopping;
+
+    /* Reader's. */
+    size_t block;
+    size_t pos;
+};
+
+
+const char* decompress_format_name(int format) {
+    switch (format) {
+    case DECOMPRESS_GZIP:
+        return "gzip";
+    case DECOMPRESS_XZ:
+        return "xz";
+    case DECOMPRESS_ZSTD:
+        return "zstd";
+    default:
+        return "uncompressed";
+    }
+}
+
+
+static int decompress_detect(const unsigned char* magic, size_t len) {
+    if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return DECOMPRESS_GZIP;
+    }
+    if (len >= 6 && !memcmp(magic, "\xfd" "7zXZ\0", 6)) {
+        return DECOMPRESS_XZ;
+    }
+    if (len >= 4 && !memcmp(magic, "\x28\xb5\x2f\xfd", 4)) {
+        return DECOMPRESS_ZSTD;
+    }
+    return DECOMPRESS_NONE;
+}
+
+
+/**
+ * Sets up the decoder for the format, if it's built in.
+ */
+static int decompress_codec_init(struct decompressor* d) {
+    switch (d->format) {
+#ifdef SUP2PGM_WITH_ZLIB
+    case DECOMPRESS_GZIP:
+        memset(&(d->gzip), 0x00, sizeof(z_stream));
+        /* 32: gzip header expected. */
+        if (inflateInit2(&(d->gzip), 15 + 32) != Z_OK) {
+            fprintf(stderr, "decompress_codec_init(): inflateInit2() failed.\n");
+            return -1;
+        }
+        return 0;
+#endif
+#ifdef SUP2PGM_WITH_LZMA
+    case DECOMPRESS_XZ:
+        memset(&(d->xz), 0x00, sizeof(lzma_stream));
+        if (lzma_stream_decoder(&(d->xz), UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+            fprintf(stderr, "decompress_codec_init(): lzma_stream_decoder() failed.\n");
+            return -1;
+        }
+        return 0;
+#endif
+#ifdef SUP2PGM_WITH_ZSTD
+    case DECOMPRESS_ZSTD:
+        if ((d->zstd = ZSTD_createDStream()) == NULL ||
+            ZSTD_isError(ZSTD_initDStream(d->zstd))) {
+            fprintf(stderr, "decompress_codec_init(): ZSTD_initDStream() failed.\n");
+            ZSTD_freeDStream(d->zstd);
+            return -1;
+        }
+        return 0;
+#endif
+    default:
+        fprintf(stderr, "Input is %s compressed, which this build doesn't support.\n",
+                decompress_format_name(d->format));
+        return -1;
+    }
+}
+
+
+static void decompress_codec_end(struct decompressor* d) {
+    switch (d->format) {
+#ifdef SUP2PGM_WITH_ZLIB
+    case DECOMPRESS_GZIP:
+        inflateEnd(&(d->gzip));
+        break;
+#endif
+#ifdef SUP2PGM_WITH_LZMA
+    case DECOMPRESS_XZ:
+        lzma_end(&(d->xz));
+        break;
+#endif
+#ifdef SUP2PGM_WITH_ZSTD
+    case DECOMPRESS_ZSTD:
+        ZSTD_freeDStream(d->zstd);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+
+/**
+ * One decoding call: consumes from in, fills out, both moved past what's
+ * done.  Returns 1 at the end of a stream, 0 if there's more to come.
+ */
+static int decompress_codec_step(struct decompressor* d,
+                                 const unsigned char** in, size_t* in_len,
+                                 unsigned char** out, size_t* out_len) {
+    int result = -1;
+
+    switch (d->format) {
+#ifdef SUP2PGM_WITH_ZLIB
+    case DECOMPRESS_GZIP: {
+        int ret;
+
+        /* Concatenated members. */
+        if (d->ended && inflateReset(&(d->gzip)) != Z_OK) {
+            return -1;
+        }
+
+        d->gzip.next_in = (Bytef*) *in;
+        d->gzip.avail_in = *in_len;
+        d->gzip.next_out = *out;
+        d->gzip.avail_out = *out_len;
+
+        ret = inflate(&(d->gzip), Z_NO_FLUSH);
+
+        *in = d->gzip.next_in;
+        *in_len = d->gzip.avail_in;
+        *out = d->gzip.next_out;
+        *out_len = d->gzip.avail_out;
+
+        if (ret == Z_STREAM_END) {
+            result = 1;
+        } else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+            result = 0;
+        } else {
+            fprintf(stderr, "gzip: %s\n", d->gzip.msg != NULL ? d->gzip.msg : "inflate() failed");
+        }
+        break;
+    }
+#endif
+#ifdef SUP2PGM_WITH_LZMA
+    case DECOMPRESS_XZ: {
+        lzma_ret ret;
+
+        d->xz.next_in = *in;
+        d->xz.avail_in = *in_len;
+        d->xz.next_out = *out;
+        d->xz.avail_out = *out_len;
+
+        /* Concatenated streams only end once told there's no more input. */
+        ret = lzma_code(&(d->xz), d->eof ? LZMA_FINISH : LZMA_RUN);
+
+        *in = d->xz.next_in;
+        *in_len = d->xz.avail_in;
+        *out = d->xz.next_out;
+        *out_len = d->xz.avail_out;
+
+        if (ret == LZMA_STREAM_END) {
+            result = 1;
+        } else if (ret == LZMA_OK || ret == LZMA_BUF_ERROR) {
+            result = 0;
+        } else {
+            fprintf(stderr, "xz: lzma_code() failed (%d).\n", (int) ret);
+        }
+        break;
+    }
+#endif
+#ifdef SUP2PGM_WITH_ZSTD
+    case DECOMPRESS_ZSTD: {
+        ZSTD_inBuffer zin = { *in, *in_len, 0 };
+        ZSTD_outBuffer zout = { *out, *out_len, 0 };
+        size_t ret;
+
+        /* Goes on to the next frame by itself. */
+        ret = ZSTD_decompressStream(d->zstd, &zout, &zin);
+
+        *in += zin.pos;
+        *in_len -= zin.pos;
+        *out += zout.pos;
+        *out_len -= zout.pos;
+
+        if (ZSTD_isError(ret)) {
+            fprintf(stderr, "zstd: %s\n", ZSTD_getErrorName(ret));
+        } else {
+            result = ret == 0;
+        }
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+
+    return result;
+}
+
+
+/**
+ * Decompresses into out until it's full.  Returns 1 if the input ended
+ * before that, 0 if it didn't, -1 on errors (truncated input included).
+ */
+static int decompress_fill(struct decompressor* d, unsigned char* out, size_t out_max, size_t* out_len) {
+    const unsigned char* in;
+    unsigned char* dest;
+    size_t in_avail, dest_avail, n;
+    int result;
+
+    *out_len = 0;
+
+    while (*out_len < out_max) {
+        if (d->in_pos == d->in_len && !d->eof) {
+            n = 0;
+            if (d->magic_len > 0) {
+                memcpy(d->in, d->magic, d->magic_len);
+                n = d->magic_len;
+                d->magic_len = 0;
+            }
+            n += fread(d->in + n, 1, DECOMPRESS_INPUT_LEN - n, d->src);
+            if (n == 0) {
+                if (ferror(d->src)) {
+                    perror("decompress_fill(): fread()");
+                    return -1;
+                }
+                d->eof = 1;
+            }
+            d->in_pos = 0;
+            d->in_len = n;
+            continue;
+        }
+
+        if (d->in_pos == d->in_len && d->ended) {
+            return 1;
+        }
+
+        in = d->in + d->in_pos;
+        in_avail = d->in_len - d->in_pos;
+        dest = out + *out_len;
+        dest_avail = out_max - *out_len;
+
+        if ((result = decompress_codec_step(d, &in, &in_avail, &dest, &dest_avail)) < 0) {
+            return -1;
+        }
+
+        n = dest - (out + *out_len);
+        d->in_pos = d->in_len - in_avail;
+        *out_len += n;
+        d->ended = result;
+
+        if (d->eof && d->in_pos == d->in_len && !d->ended && n == 0) {
+            fprintf(stderr, "Compressed input is truncated.\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static void* decompress_thread(void* arg) {
+    struct decompressor* d = arg;
+    size_t b = 0, len;
+    int result = 0;
+
+    while (result == 0) {
+        pthread_mutex_lock(&(d->lock));
+        while (d->full[b] && !d->stopping) {
+            pthread_cond_wait(&(d->cond), &(d->lock));
+        }
+        if (d->stopping) {
+            pthread_mutex_unlock(&(d->lock));
+            break;
+        }
+        pthread_mutex_unlock(&(d->lock));
+
+        result = decompress_fill(d, d->blocks[b], DECOMPRESS_BLOCK_LEN, &len);
+
+        pthread_mutex_lock(&(d->lock));
+        /* What's decoded before an error is still good. */
+        d->lens[b] = len;
+        d->full[b] = len > 0;
+        if (result != 0) {
+            d->done = 1;
+            d->failed = result < 0;
+        }
+        pthread_cond_broadcast(&(d->cond));
+        pthread_mutex_unlock(&(d->lock));
+
+        b ^= 1;
+    }
+
+    return NULL;
+}
+
+
+static ssize_t decompress_read(void* cookie, char* buf, size_t size) {
+    struct decompressor* d = cookie;
+    size_t b, n, copied = 0;
+    int failed;
+
+    while (copied < size) {
+        b = d->block;
+
+        pthread_mutex_lock(&(d->lock));
+        while (!d->full[b] && !d->done) {
+            pthread_cond_wait(&(d->cond), &(d->lock));
+        }
+        failed = !d->full[b] && d->failed;
+        if (!d->full[b]) {
+            pthread_mutex_unlock(&(d->lock));
+            if (copied == 0 && failed) {
+                errno = EIO;
+                return -1;
+            }
+            break;
+        }
+        pthread_mutex_unlock(&(d->lock));
+
+        n = d->lens[b] - d->pos;
+        if (n > size - copied) {
+            n = size - copied;
+        }
+        memcpy(buf + copied, d->blocks[b] + d->pos, n);
+        copied += n;
+        d->pos += n;
+
+        if (d->pos == d->lens[b]) {
+            /* Hand the block back. */
+            d->pos = 0;
+            d->block = b ^ 1;
+
+            pthread_mutex_lock(&(d->lock));
+            d->full[b] = 0;
+            pthread_cond_broadcast(&(d->cond));
+            pthread_mutex_unlock(&(d->lock));
+        }
+    }
+
+    return copied;
+}
+
+
+static int decompress_seek(void* cookie, off64_t* offset, int whence) {
+    errno = ESPIPE;
+    return -1;
+}
+
+
+static void decompress_free(struct decompressor* d) {
+    free(d->in);
+    free(d->blocks[0]);
+    free(d->blocks[1]);
+    free(d);
+}
+
+
+static int decompress_close(void* cookie) {
+    struct decompressor* d = cookie;
+    int result;
+
+    if (d->started) {
+        pthread_mutex_lock(&(d->lock));
+        d->stopping = 1;
+        pthread_cond_broadcast(&(d->cond));
+        pthread_mutex_unlock(&(d->lock));
+        pthread_join(d->thread, NULL);
+    }
+
+    pthread_cond_destroy(&(d->cond));
+    pthread_mutex_destroy(&(d->lock));
+    decompress_codec_end(d);
+
+    result = d->src != NULL ? fclose(d->src) : 0;
+    decompress_free(d);
+
+    return result;
+}
+
+
+/**
+ * Tells compressed input by its magic bytes.  Returns src itself if it
+ * isn't, a stream of the decompressed data if it is (closing it closes
+ * src too), NULL on errors.  The decompressed stream can't be seeked.
+ */
+FILE* decompress_open(FILE* src, int* format) {
+    cookie_io_functions_t io = {
+        decompress_read,
+        NULL,
+        decompress_seek,
+        decompress_close
+    };
+    struct decompressor* d;
+    unsigned char magic[DECOMPRESS_MAGIC_LEN];
+    size_t magic_len;
+    FILE* fd;
+    int c;
+
+    *format = DECOMPRESS_NONE;
+
+    /* A SUP stream starts with "PG", one byte can always be put back. */
+    if ((c = fgetc(src)) == EOF) {
+        return src;
+    }
+    ungetc(c, src);
+    if (c == (SUP_PACKET_MARKER >> 8)) {
+        return src;
+    }
+
+    magic_len = fread(magic, 1, DECOMPRESS_MAGIC_LEN, src);
+    if ((*format = decompress_detect(magic, magic_len)) == DECOMPRESS_NONE) {
+        /* Garbage, let the packet reader complain about it. */
+        if (fseeko(src, -(off_t) magic_len, SEEK_CUR)) {
+            fprintf(stderr, "Unknown input format.\n");
+            return NULL;
+        }
+        return src;
+    }
+
+    if ((d = mem_calloc(1, sizeof(struct decompressor))) == NULL) {
+        perror("decompress_open(): calloc()");
+        return NULL;
+    }
+    d->src = src;
+    d->format = *format;
+    memcpy(d->magic, magic, magic_len);
+    d->magic_len = magic_len;
+
+    d->in = mem_alloc(DECOMPRESS_INPUT_LEN);
+    d->blocks[0] = mem_alloc(DECOMPRESS_BLOCK_LEN);
+    d->blocks[1] = mem_alloc(DECOMPRESS_BLOCK_LEN);
+    if (d->in == NULL || d->blocks[0] == NULL || d->blocks[1] == NULL) {
+        perror("decompress_open(): malloc()");
+        decompress_free(d);
+        return NULL;
+    }
+
+    if (decompress_codec_init(d)) {
+        decompress_free(d);
+        return NULL;
+    }
+
+    pthread_mutex_init(&(d->lock), NULL);
+    pthread_cond_init(&(d->cond), NULL);
+
+    if ((fd = fopencookie(d, "rb", io)) == NULL) {
+        perror("decompress_open(): fopencookie()");
+        pthread_cond_destroy(&(d->cond));
+        pthread_mutex_destroy(&(d->lock));
+        decompress_codec_end(d);
+        decompress_free(d);
+        return NULL;
+    }
+
+    if (pthread_create(&(d->thread), NULL, decompress_thread, d)) {
+        perror("decompress_open(): pthread_create()");
+        /* src is the caller's to close. */
+        d->src = NULL;
+        fclose(fd);
+        return NULL;
+    }
+    d->started = 1;
+
+    return fd;
+}
@@ -0,0 +1,19 @@
+#ifndef SUP2PGM_DECOMPRESS_H
+#define SUP2PGM_DECOMPRESS_H
+
+#include <stdio.h>
+
+/* Decompressed data is handed over to the reader in blocks this long. */
+#define DECOMPRESS_BLOCK_LEN (1024 * 1024)
+#define DECOMPRESS_INPUT_LEN (256 * 1024)
+
+#define DECOMPRESS_NONE 0
+#define DECOMPRESS_GZIP 1
+#define DECOMPRESS_XZ 2
+#define DECOMPRESS_ZSTD 3
+
+
+const char* decompress_format_name(int format);
+FILE* decompress_open(FILE* src, int* format);
+
+#endif  /* SUP2PGM_DECOMPRESS_H */
@@ -0,0 +1,193 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canvas.h"
+#include "delta.h"
+#include "mem.h"
+#include "pgm.h"
+
+
+int delta_init(struct delta_writer* writer, const char* base_filename) {
+    if (writer == NULL || base_filename == NULL) {
+        return -1;
+    }
+
+    memset(writer, 0x00, sizeof(struct delta_writer));
+    writer->base_filename = base_filename;
+    writer->base_num = DELTA_NONE;
+    writer->pending.num = DELTA_NONE;
+    canvas_init(&(writer->base));
+    canvas_init(&(writer->prev));
+
+    /* "<base><number>.pgm" */
+    if ((writer->filename = mem_alloc(strlen(base_filename) + 30)) == NULL) {
+        perror("delta_init(): malloc()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void delta_free(struct delta_writer* writer) {
+    canvas_free(&(writer->base));
+    canvas_free(&(writer->prev));
+    free(writer->filename);
+    free(writer->img);
+
+    writer->filename = NULL;
+    writer->img = NULL;
+}
+
+
+const char* delta_filename(struct delta_writer* writer, size_t num) {
+    sprintf(writer->filename, "%s%05lu.pgm", writer->base_filename, num);
+    return writer->filename;
+}
+
+
+static int delta_write_keyframe(struct delta_writer* writer, const struct canvas* canvas,
+                                struct delta_entry* entry) {
+    FILE* img_file;
+    int result;
+
+    if ((img_file = fopen(delta_filename(writer, entry->num), "wb")) == NULL) {
+        perror("delta_write_keyframe(): fopen()");
+        return -1;
+    }
+    result = canvas_write_pgm(img_file, canvas);
+    fclose(img_file);
+    if (result || canvas_assign(&(writer->base), canvas)) {
+        writer->base_num = DELTA_NONE;
+        return -1;
+    }
+
+    writer->base_num = entry->num;
+    entry->base_num = DELTA_NONE;
+    entry->x = 0;
+    entry->y = 0;
+    entry->width = canvas->width;
+    entry->height = canvas->height;
+    writer->keyframes++;
+
+    return 0;
+}
+
+
+/**
+ * Writes the area of the caption in entry as a patch.  Returns -1 if it
+ * can't be, e.g. when all there is to it is erasing.
+ */
+static int delta_write_patch(struct delta_writer* writer, const struct canvas* canvas,
+                             const struct delta_entry* entry) {
+    unsigned char* img;
+    size_t len = entry->width * entry->height, y;
+    FILE* img_file;
+    int result;
+
+    if (len > writer->img_max_len) {
+        if ((img = mem_realloc(writer->img, len)) == NULL) {
+            perror("delta_write_patch(): realloc()");
+            return -1;
+        }
+        writer->img = img;
+        writer->img_max_len = len;
+    }
+
+    for (y = 0; y < entry->height; y++) {
+        canvas_copy_span(canvas, entry->y + y, entry->x, entry->x + entry->width,
+                         writer->img + y * entry->width);
+    }
+    if (pgm_max_gray(writer->img, entry->width, entry->height) == 0x00) {
+        return -1;
+    }
+
+    if ((img_file = fopen(delta_filename(writer, entry->num), "wb")) == NULL) {
+        perror("delta_write_patch(): fopen()");
+        return -1;
+    }
+    result = pgm_write(img_file, writer->img, entry->width, entry->height);
+    fclose(img_file);
+    if (result) {
+        return -1;
+    }
+
+    writer->patches++;
+    return 0;
+}
+
+
+/**
+ * Takes the next caption.  Returns DELTA_EXTENDED if it's the previous one
+ * showing on, DELTA_WRITTEN if it got an entry and an image of its own,
+ * -1 if it's blank or couldn't be written.  done is set to the entry
+ * that's complete now, if there's one (its num isn't DELTA_NONE).
+ */
+int delta_add(struct delta_writer* writer, const struct canvas* canvas,
+              size_t subtitle_num, uint32_t start_time, uint32_t end_time,
+              struct delta_entry* done) {
+    struct delta_entry entry;
+    size_t x0, y0, x1, y1, bx0, by0, bx1, by1;
+    int same_size;
+
+    done->num = DELTA_NONE;
+
+    if (canvas->live_cnt == 0 || canvas_max_gray(canvas) == 0x00) {
+        return -1;
+    }
+
+    same_size = canvas->width == writer->prev.width && canvas->height == writer->prev.height;
+
+    /* Nothing's changed since the last one, and it's still showing? */
+    if (writer->pending.num != DELTA_NONE && same_size &&
+        writer->pending.end_time == start_time &&
+        canvas_diff(canvas, &(writer->prev), &x0, &y0, &x1, &y1)) {
+        writer->pending.end_time = end_time;
+        writer->extended++;
+        return DELTA_EXTENDED;
+    }
+
+    entry.num = subtitle_num;
+    entry.base_num = writer->base_num;
+    entry.start_time = start_time;
+    entry.end_time = end_time;
+
+    if (writer->base_num != DELTA_NONE && same_size &&
+        !canvas_diff(canvas, &(writer->base), &x0, &y0, &x1, &y1) &&
+        !canvas_bounds(canvas, &bx0, &by0, &bx1, &by1) &&
+        (x1 - x0) * (y1 - y0) * 100 <= (bx1 - bx0) * (by1 - by0) * DELTA_MAX_AREA_PCT) {
+        entry.x = x0;
+        entry.y = y0;
+        entry.width = x1 - x0;
+        entry.height = y1 - y0;
+        if (delta_write_patch(writer, canvas, &entry) &&
+            delta_write_keyframe(writer, canvas, &entry)) {
+            return -1;
+        }
+    } else if (delta_write_keyframe(writer, canvas, &entry)) {
+        return -1;
+    }
+
+    if (canvas_assign(&(writer->prev), canvas)) {
+        /* Can't be compared with, start over from a keyframe. */
+        canvas_free(&(writer->prev));
+        writer->base_num = DELTA_NONE;
+    }
+
+    *done = writer->pending;
+    writer->pending = entry;
+
+    return DELTA_WRITTEN;
+}
+
+
+/**
+ * Hands over the last entry.  Returns -1 if there's none.
+ */
+int delta_finish(struct delta_writer* writer, struct delta_entry* done) {
+    *done = writer->pending;
+    writer->pending.num = DELTA_NONE;
+    return done->num != DELTA_NONE ? 0 : -1;
+}
@@ -0,0 +1,71 @@
+#ifndef SUP2PGM_DELTA_H
+#define SUP2PGM_DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "canvas.h"
+
+/* A change covering more than that much of the caption makes a keyframe. */
+#define DELTA_MAX_AREA_PCT 50
+
+/* No entry. */
+#define DELTA_NONE ((size_t) -1)
+
+/* delta_add() results besides -1. */
+#define DELTA_WRITTEN 0
+#define DELTA_EXTENDED 1
+
+
+/**
+ * Caption written either as a keyframe, the whole canvas, or as a patch
+ * over the last keyframe: the area of it that changed.
+ */
+struct delta_entry {
+    size_t num;        /* Image number */
+    size_t base_num;   /* Keyframe patched, DELTA_NONE for a keyframe */
+    uint32_t start_time;
+    uint32_t end_time;
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+};
+
+
+/**
+ * Delta output for captions that change a little at a time (karaoke,
+ * typewriter effects).  Each caption is compared with the previous one:
+ * the same one showing on extends its entry, a different one is written
+ * as a patch over the last keyframe unless too much of it changed.
+ * Entries are held until their timing is known for good.
+ */
+struct delta_writer {
+    const char* base_filename;
+    char* filename;
+
+    struct canvas base;  /* Last keyframe */
+    struct canvas prev;  /* Last caption written */
+    size_t base_num;
+
+    struct delta_entry pending;
+
+    unsigned char* img;
+    size_t img_max_len;
+
+    size_t keyframes;
+    size_t patches;
+    size_t extended;
+};
+
+
+int delta_init(struct delta_writer* writer, const char* base_filename);
+void delta_free(struct delta_writer* writer);
+
+int delta_add(struct delta_writer* writer, const struct canvas* canvas,
+              size_t subtitle_num, uint32_t start_time, uint32_t end_time,
+              struct delta_entry* done);
+int delta_finish(struct delta_writer* writer, struct delta_entry* done);
+const char* delta_filename(struct delta_writer* writer, size_t num);
+
+#endif  /* SUP2PGM_DELTA_H */
@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "follow.h"
+#include "sup.h"
+
+
+static unsigned long follow_elapsed_ms(const struct timespec* since) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 +
+           (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+
+/**
+ * Waits for the file to grow: until it's modified if it's being watched,
+ * for a while otherwise.  Gives up once idle for longer than the timeout.
+ */
+static void follow_wait(struct follow_reader* reader, const struct timespec* idle_since, long* ns) {
+    unsigned long elapsed_ms = follow_elapsed_ms(idle_since);
+    unsigned long left_ms = reader->idle_timeout_ms - elapsed_ms;
+    char events[4096];
+    struct pollfd pfd;
+    struct timespec ts;
+
+    if (reader->idle_timeout_ms > 0 && elapsed_ms >= reader->idle_timeout_ms) {
+        reader->done = 1;
+        return;
+    }
+
+    if (reader->inotify_fd >= 0) {
+        pfd.fd = reader->inotify_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (left_ms > INT_MAX) {
+            /* Waking up early only means checking again. */
+            left_ms = INT_MAX;
+        }
+        if (poll(&pfd, 1, reader->idle_timeout_ms > 0 ? (int) left_ms : -1) > 0) {
+            /* Only the fact something happened matters. */
+            while (read(reader->inotify_fd, events, sizeof(events)) > 0) {
+            }
+        }
+        return;
+    }
+
+    if (reader->idle_timeout_ms > 0 && *ns / 1000000 > left_ms) {
+        *ns = left_ms * 1000000 + 1;
+    }
+    ts.tv_sec = *ns / 1000000000;
+    ts.tv_nsec = *ns % 1000000000;
+    nanosleep(&ts, NULL);
+
+    if (*ns < FOLLOW_BACKOFF_MAX) {
+        *ns *= 2;
+    }
+}
+
+
+int follow_open(struct follow_reader* reader, int fd, const char* path,
+                unsigned long idle_timeout_ms) {
+    struct stat st;
+
+    if (reader == NULL || fd < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st)) {
+        perror("follow_open(): fstat()");
+        return -1;
+    }
+
+    reader->fd = fd;
+    reader->inotify_fd = -1;
+    reader->regular = S_ISREG(st.st_mode);
+    reader->done = 0;
+    reader->error = 0;
+    reader->idle_timeout_ms = idle_timeout_ms;
+    if ((reader->origin = lseek(fd, 0, SEEK_CUR)) < 0) {
+        reader->origin = 0;
+    }
+    reader->offset = reader->origin;
+
+    if (parser_init(&(reader->parser))) {
+        return -1;
+    }
+
+    if (reader->regular && path != NULL) {
+        /* Fall back to polling if the file can't be watched. */
+        reader->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (reader->inotify_fd >= 0 &&
+            inotify_add_watch(reader->inotify_fd, path, IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+            close(reader->inotify_fd);
+            reader->inotify_fd = -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Returns 0 once a complete packet is read, -1 on a bad packet or when
+ * done (see reader->done).
+ */
+int follow_read_packet(struct follow_reader* reader, struct sup_packet* packet) {
+    struct timespec idle_since;
+    long backoff = FOLLOW_BACKOFF_MIN;
+    struct sup_packet parsed;
+    void* segment;
+    ssize_t n;
+    int result;
+
+    if (sup_init_packet(packet)) {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &idle_since);
+
+    while (!reader->done) {
+        result = parser_next(&(reader->parser), &parsed);
+        reader->offset = reader->origin + reader->parser.offset;
+        if (result < 0) {
+            reader->error = 1;
+            return -1;
+        } else if (result > 0) {
+            segment = packet->segment;
+            *packet = parsed;
+            packet->segment = segment;
+            memcpy(packet->segment, parsed.segment, parsed.segment_len);
+            return 0;
+        }
+
+        /* The parser's done with the buffer. */
+        n = read(reader->fd, reader->buf, FOLLOW_BUF_LEN);
+        if (n > 0) {
+            parser_feed(&(reader->parser), reader->buf, n);
+            backoff = FOLLOW_BACKOFF_MIN;
+            clock_gettime(CLOCK_MONOTONIC, &idle_since);
+        } else if (n < 0 && errno != EINTR) {
+            perror("follow_read_packet(): read()");
+            reader->error = 1;
+            reader->done = 1;
+        } else if (n == 0 && !reader->regular) {
+            /* Writer's gone. */
+            reader->done = 1;
+        } else if (n == 0) {
+            follow_wait(reader, &idle_since, &backoff);
+        }
+    }
+
+    if (parser_pending(&(reader->parser))) {
+        fprintf(stderr, "Unexpected EOF.\n");
+        reader->error = 1;
+    }
+
+    return -1;
+}
+
+
+void follow_close(struct follow_reader* reader) {
+    parser_free(&(reader->parser));
+    if (reader->inotify_fd >= 0) {
+        close(reader->inotify_fd);
+        reader->inotify_fd = -1;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef SUP2PGM_FOLLOW_H
+#define SUP2PGM_FOLLOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "parser.h"
+#include "sup.h"
+
+#define FOLLOW_BUF_LEN (SUP_PACKET_HEADER_LEN + SUP_PACKET_MAX_SEGMENT_LEN)
+
+/* Polling backoff while waiting for more data, in nanoseconds. */
+#define FOLLOW_BACKOFF_MIN 1000000
+#define FOLLOW_BACKOFF_MAX 100000000
+
+
+/**
+ * Reads packets off a file that's still being written: EOF means waiting
+ * for more data (inotify if available, polling with backoff otherwise),
+ * a partially written packet stays in the parser until it's complete.
+ */
+struct follow_reader {
+    int fd;
+    int inotify_fd;        /* -1 when polling */
+    uint8_t regular;       /* EOF of a pipe is final */
+    uint8_t done;          /* Idle for too long, or the input is gone */
+    uint8_t error;         /* Bad or unreadable input seen */
+    unsigned long idle_timeout_ms;  /* 0 waits forever */
+    off_t origin;          /* Where reading started */
+    off_t offset;          /* Of the next packet in the file */
+    struct push_parser parser;
+    unsigned char buf[FOLLOW_BUF_LEN];
+};
+
+
+int follow_open(struct follow_reader* reader, int fd, const char* path,
+                unsigned long idle_timeout_ms);
+int follow_read_packet(struct follow_reader* reader, struct sup_packet* packet);
+void follow_close(struct follow_reader* reader);
+
+#endif  /* SUP2PGM_FOLLOW_H */
@@ -0,0 +1,230 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canvas.h"
+#include "decoder.h"
+#include "lines.h"
+#include "mem.h"
+#include "pgm.h"
+#include "sink.h"
+#include "sup.h"
+
+
+int lines_init(struct line_splitter* splitter, const char* base_filename, size_t min_gap) {
+    if (splitter == NULL || base_filename == NULL || min_gap == 0) {
+        return -1;
+    }
+
+    memset(splitter, 0x00, sizeof(struct line_splitter));
+    splitter->base_filename = base_filename;
+    splitter->min_gap = min_gap;
+
+    /* "<base><number>_<line>.pgm" */
+    splitter->filename = mem_alloc(strlen(base_filename) + 30);
+    /* As tall as an object can be. */
+    splitter->obj_rows = mem_alloc(0x10000);
+    if (splitter->filename == NULL || splitter->obj_rows == NULL) {
+        perror("lines_init(): malloc()");
+        lines_free(splitter);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void lines_free(struct line_splitter* splitter) {
+    free(splitter->filename);
+    free(splitter->rows);
+    free(splitter->obj_rows);
+    free(splitter->img);
+
+    splitter->filename = NULL;
+    splitter->rows = NULL;
+    splitter->obj_rows = NULL;
+    splitter->img = NULL;
+}
+
+
+int lines_resize(struct line_splitter* splitter, size_t height) {
+    uint8_t* rows;
+
+    if (height == splitter->rows_len) {
+        return 0;
+    }
+
+    if ((rows = mem_realloc(splitter->rows, height)) == NULL) {
+        perror("lines_resize(): realloc()");
+        return -1;
+    }
+    splitter->rows = rows;
+    splitter->rows_len = height;
+    lines_clear(splitter);
+
+    return 0;
+}
+
+
+void lines_clear(struct line_splitter* splitter) {
+    memset(splitter->rows, 0x00, splitter->rows_len);
+    splitter->lines_cnt = 0;
+}
+
+
+int lines_set_palette(struct line_splitter* splitter, const struct sup_segment_pds* pds) {
+    return sup_palette_lut(pds, SUP_CHANNEL_GRAY, splitter->lut);
+}
+
+
+/**
+ * Marks the canvas rows the object shows on, from its RLE data and the
+ * palette last set, clipped to its window.
+ */
+void lines_add_object(struct line_splitter* splitter, const struct subimage* subimg,
+                      const struct sink_object* placement) {
+    size_t y, y0, y1;
+
+    memset(splitter->obj_rows, 0x00, subimg->height);
+    if (!sink_rle_rows(subimg->img, subimg->len, splitter->lut,
+                       splitter->obj_rows, subimg->height)) {
+        return;
+    }
+
+    y0 = placement->y > placement->window_y ? placement->y : placement->window_y;
+    y1 = placement->y + subimg->height;
+    if (y1 > placement->window_y + placement->window_height) {
+        y1 = placement->window_y + placement->window_height;
+    }
+    if (y1 > splitter->rows_len) {
+        y1 = splitter->rows_len;
+    }
+
+    for (y = y0; y < y1; y++) {
+        splitter->rows[y] |= splitter->obj_rows[y - placement->y];
+    }
+}
+
+
+static int lines_grow(struct line_splitter* splitter, size_t len) {
+    unsigned char* img;
+
+    if (len <= splitter->img_max_len) {
+        return 0;
+    }
+    if ((img = mem_realloc(splitter->img, len)) == NULL) {
+        perror("lines_grow(): realloc()");
+        return -1;
+    }
+    splitter->img = img;
+    splitter->img_max_len = len;
+    return 0;
+}
+
+
+/**
+ * Fits a box to the visible pixels of rows y0 to y1.  Returns -1 if
+ * there are none, i.e. whatever was marked got drawn over or clipped.
+ */
+static int lines_fit(struct line_splitter* splitter, const struct canvas* canvas,
+                     size_t x0, size_t x1, size_t y0, size_t y1, struct line_box* box) {
+    size_t bx0 = x1, bx1 = x0, by0 = y1, by1 = y0, x, y;
+
+    for (y = y0; y < y1; y++) {
+        canvas_copy_span(canvas, y, x0, x1, splitter->img);
+        for (x = x0; x < x1; x++) {
+            if (splitter->img[x - x0] != 0x00) {
+                bx0 = x < bx0 ? x : bx0;
+                bx1 = x + 1 > bx1 ? x + 1 : bx1;
+                by0 = y < by0 ? y : by0;
+                by1 = y + 1;
+            }
+        }
+    }
+
+    if (bx1 <= bx0) {
+        return -1;
+    }
+
+    box->x = bx0;
+    box->y = by0;
+    box->width = bx1 - bx0;
+    box->height = by1 - by0;
+    return 0;
+}
+
+
+/**
+ * Splits the caption into lines at runs of at least min_gap blank rows,
+ * the last one takes whatever's left past LINES_MAX.  Returns how many
+ * there are.
+ */
+size_t lines_find(struct line_splitter* splitter, const struct canvas* canvas) {
+    size_t x0, y0, x1, y1, y, start, end, gap;
+
+    splitter->lines_cnt = 0;
+    if (canvas_bounds(canvas, &x0, &y0, &x1, &y1) || lines_grow(splitter, x1 - x0)) {
+        return 0;
+    }
+    if (y1 > splitter->rows_len) {
+        y1 = splitter->rows_len;
+    }
+
+    for (y = y0; y < y1; ) {
+        if (!splitter->rows[y]) {
+            y++;
+            continue;
+        }
+
+        start = y;
+        end = ++y;
+        for (gap = 0; y < y1; y++) {
+            if (splitter->rows[y]) {
+                end = y + 1;
+                gap = 0;
+            } else if (++gap >= splitter->min_gap &&
+                       splitter->lines_cnt < LINES_MAX - 1) {
+                break;
+            }
+        }
+
+        if (!lines_fit(splitter, canvas, x0, x1, start, end,
+                       &(splitter->lines[splitter->lines_cnt]))) {
+            splitter->lines_cnt++;
+        }
+    }
+
+    return splitter->lines_cnt;
+}
+
+
+/**
+ * Writes line i of the caption found last, cropped off the canvas.
+ * Returns the image file name, NULL if it couldn't be written.
+ */
+const char* lines_write(struct line_splitter* splitter, const struct canvas* canvas,
+                        size_t subtitle_num, size_t i) {
+    const struct line_box* box = &(splitter->lines[i]);
+    FILE* img_file;
+    size_t y;
+    int result;
+
+    if (lines_grow(splitter, box->width * box->height)) {
+        return NULL;
+    }
+    for (y = 0; y < box->height; y++) {
+        canvas_copy_span(canvas, box->y + y, box->x, box->x + box->width,
+                         splitter->img + y * box->width);
+    }
+
+    sprintf(splitter->filename, "%s%05lu_%02lu.pgm", splitter->base_filename, subtitle_num, i);
+    if ((img_file = fopen(splitter->filename, "wb")) == NULL) {
+        perror("lines_write(): fopen()");
+        return NULL;
+    }
+    result = pgm_write(img_file, splitter->img, box->width, box->height);
+    fclose(img_file);
+
+    return result ? NULL : splitter->filename;
+}
@@ -0,0 +1,60 @@
+#ifndef SUP2PGM_LINES_H
+#define SUP2PGM_LINES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "canvas.h"
+#include "decoder.h"
+#include "sink.h"
+#include "sup.h"
+
+#define LINES_MAX 64
+
+
+struct line_box {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+};
+
+
+/**
+ * Text lines of the current caption.  Rows with anything visible are
+ * marked from the objects' RLE data as they're rendered, lines are the
+ * runs of them apart by at least min_gap blank rows, cropped off the
+ * canvas when saved.
+ */
+struct line_splitter {
+    const char* base_filename;
+    char* filename;
+    size_t min_gap;
+
+    uint8_t lut[0x100];  /* Palette of the current composition */
+    uint8_t* rows;       /* Canvas rows with something on them */
+    uint8_t* obj_rows;   /* Rows of the object being marked */
+    size_t rows_len;
+
+    struct line_box lines[LINES_MAX];
+    size_t lines_cnt;
+
+    unsigned char* img;
+    size_t img_max_len;
+};
+
+
+int lines_init(struct line_splitter* splitter, const char* base_filename, size_t min_gap);
+void lines_free(struct line_splitter* splitter);
+
+int lines_resize(struct line_splitter* splitter, size_t height);
+void lines_clear(struct line_splitter* splitter);
+int lines_set_palette(struct line_splitter* splitter, const struct sup_segment_pds* pds);
+void lines_add_object(struct line_splitter* splitter, const struct subimage* subimg,
+                      const struct sink_object* placement);
+
+size_t lines_find(struct line_splitter* splitter, const struct canvas* canvas);
+const char* lines_write(struct line_splitter* splitter, const struct canvas* canvas,
+                        size_t subtitle_num, size_t i);
+
+#endif  /* SUP2PGM_LINES_H */
@@ -0,0 +1,82 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+
+#define ARENA_ALIGN 16
+
+
+/* Number of heap (re)allocations made so far, see mem_allocs(). */
+static unsigned long heap_allocs = 0;
+
+
+void* mem_alloc(size_t len) {
+    heap_allocs++;
+    return malloc(len);
+}
+
+
+void* mem_calloc(size_t num, size_t len) {
+    heap_allocs++;
+    return calloc(num, len);
+}
+
+
+void* mem_realloc(void* ptr, size_t len) {
+    heap_allocs++;
+    return realloc(ptr, len);
+}
+
+
+unsigned long mem_allocs(void) {
+    return heap_allocs;
+}
+
+
+int arena_init(struct arena* arena, size_t size) {
+    if (arena == NULL) {
+        return -1;
+    }
+
+    arena->size = size;
+    arena->used = 0;
+    if ((arena->base = mem_alloc(size)) == NULL) {
+        perror("arena_init(): malloc()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void* arena_alloc(struct arena* arena, size_t len) {
+    void* ptr;
+
+    /* Keep every piece aligned for any scalar type. */
+    len = (len + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+
+    if (arena->base == NULL || arena->size - arena->used < len) {
+        fprintf(stderr, "Arena exhausted.\n");
+        return NULL;
+    }
+
+    ptr = arena->base + arena->used;
+    arena->used += len;
+
+    return ptr;
+}
+
+
+void arena_reset(struct arena* arena) {
+    arena->used = 0;
+}
+
+
+void arena_free(struct arena* arena) {
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+}
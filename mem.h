@@ -0,0 +1,28 @@
+#ifndef SUP2PGM_MEM_H
+#define SUP2PGM_MEM_H
+
+#include <stddef.h>
+
+
+/**
+ * Bump allocator: one heap block carved into pieces which are released
+ * all at once.
+ */
+struct arena {
+    unsigned char* base;
+    size_t size;
+    size_t used;
+};
+
+
+void* mem_alloc(size_t len);
+void* mem_calloc(size_t num, size_t len);
+void* mem_realloc(void* ptr, size_t len);
+unsigned long mem_allocs(void);
+
+int arena_init(struct arena* arena, size_t size);
+void* arena_alloc(struct arena* arena, size_t len);
+void arena_reset(struct arena* arena);
+void arena_free(struct arena* arena);
+
+#endif  /* SUP2PGM_MEM_H */
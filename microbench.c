@@ -0,0 +1,722 @@
+/**
+ * SUP2PGM-MICROBENCH
+ * Times the decoder's hot kernels on synthetic in-memory captions and
+ * prints one JSON object per kernel, so runs can be compared by script.
+ *
+ * Copyright (c) 2013, Sergey Kolchin <ksa242@gmail.com>
+ * All rights reserved.
+ * Released under 3-clause BSD License.
+ */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "canvas.h"
+#include "decoder.h"
+#include "pgm.h"
+#include "sink.h"
+#include "sup.h"
+
+#define MICROBENCH_PROGRAM_NAME "sup2pgm-microbench"
+
+/* Synthetic caption: two lines of glyph-like runs on a 1080p screen. */
+#define MICROBENCH_VIDEO_WIDTH 1920
+#define MICROBENCH_VIDEO_HEIGHT 1080
+#define MICROBENCH_OBJ_WIDTH 1600
+#define MICROBENCH_OBJ_HEIGHT 140
+#define MICROBENCH_OBJ_X 160
+#define MICROBENCH_OBJ_Y 900
+
+/* Display sets in the stream sup_read_packet() goes through. */
+#define MICROBENCH_STREAM_SETS 64
+
+/* Batches are grown until they take that long, repetitions are batches. */
+#define MICROBENCH_MIN_BATCH_NS 10000000ULL
+#define MICROBENCH_DEFAULT_REPS 15
+#define MICROBENCH_MAX_REPS 1000
+
+#define MICROBENCH_COUNTERS 3
+#define MICROBENCH_KERNELS 10
+
+#define MICROBENCH_ODS_FIRST_HEADER_LEN 11
+#define MICROBENCH_ODS_HEADER_LEN 4
+
+
+/**
+ * Inputs shared by the kernels, set up once.
+ */
+struct bench_data {
+    unsigned char* stream;  /* Display sets back to back */
+    size_t stream_len;
+    size_t stream_packets;
+    FILE* stream_fd;
+
+    struct sup_packet pcs_packet;
+    struct sup_packet pds_packet;
+    struct sup_packet wds_packet;
+    struct sup_packet ods_packet;  /* First fragment */
+
+    struct sup_decoder dec;
+    struct subimage* subimg;
+    struct sink_object obj;
+
+    struct canvas canvas;
+    struct sink_gray gray_sink;
+
+    unsigned char* img;     /* Dense screen sized image */
+    struct sink_index index_sink;
+
+    FILE* null_fd;
+};
+
+
+struct bench {
+    const char* name;
+    void (*run)(struct bench_data* data);
+    size_t pixels;   /* Per run, 0 if it doesn't apply */
+    size_t packets;
+    size_t bytes;
+};
+
+
+struct bench_counters {
+    int fds[MICROBENCH_COUNTERS];
+    int ok;
+};
+
+
+/* Deterministic input, the same on every run. */
+static uint32_t bench_random(void) {
+    static uint32_t state = 0x2545f491;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+
+static void bench_put_run(unsigned char** out, uint8_t color, size_t n) {
+    unsigned char* p = *out;
+
+    if (color != 0x00 && n < 3) {
+        while (n-- > 0) {
+            *p++ = color;
+        }
+    } else if (color == 0x00 && n < 64) {
+        *p++ = 0x00;
+        *p++ = n;
+    } else if (color == 0x00) {
+        *p++ = 0x00;
+        *p++ = 0x40 | (n >> 8);
+        *p++ = n & 0xff;
+    } else if (n < 64) {
+        *p++ = 0x00;
+        *p++ = 0x80 | n;
+        *p++ = color;
+    } else {
+        *p++ = 0x00;
+        *p++ = 0xc0 | (n >> 8);
+        *p++ = n & 0xff;
+        *p++ = color;
+    }
+
+    *out = p;
+}
+
+
+/**
+ * Encodes the synthetic object: text lines with a blank gap between
+ * them, glyph strokes of 1 to 12 pixels in three colors.
+ */
+static size_t bench_encode_object(unsigned char* out) {
+    unsigned char* p = out;
+    size_t x, y, n;
+    uint8_t color;
+
+    for (y = 0; y < MICROBENCH_OBJ_HEIGHT; y++) {
+        if (y < 10 || (y >= 60 && y < 80) || y >= MICROBENCH_OBJ_HEIGHT - 10) {
+            bench_put_run(&p, 0x00, MICROBENCH_OBJ_WIDTH);
+        } else {
+            for (x = 0; x < MICROBENCH_OBJ_WIDTH; x += n) {
+                n = 1 + bench_random() % 12;
+                if (n > MICROBENCH_OBJ_WIDTH - x) {
+                    n = MICROBENCH_OBJ_WIDTH - x;
+                }
+                color = bench_random() % 5;
+                color = color < 2 ? 0x00 : color - 1;
+                bench_put_run(&p, color, n);
+            }
+        }
+        *p++ = 0x00;
+        *p++ = 0x00;
+    }
+
+    return p - out;
+}
+
+
+static int bench_add_packet(struct bench_data* data, uint8_t type, const unsigned char* segment, size_t len) {
+    struct sup_packet packet;
+
+    memset(&packet, 0x00, sizeof(packet));
+    packet.marker = SUP_PACKET_MARKER;
+    packet.pts = data->stream_packets * SUP_PTS_FREQ;
+    packet.segment_type = type;
+    packet.segment_len = len;
+    sup_serialize_packet_header(&packet, data->stream + data->stream_len);
+    memcpy(data->stream + data->stream_len + SUP_PACKET_HEADER_LEN, segment, len);
+
+    data->stream_len += SUP_PACKET_HEADER_LEN + len;
+    data->stream_packets++;
+    return 0;
+}
+
+
+/* Keeps a copy of the packet last added. */
+static int bench_keep_packet(const struct bench_data* data, struct sup_packet* packet, size_t offset) {
+    packet->segment = NULL;
+    if (sup_init_packet(packet) ||
+        sup_parse_packet_header(data->stream + offset, packet)) {
+        return -1;
+    }
+    memcpy(packet->segment, data->stream + offset + SUP_PACKET_HEADER_LEN, packet->segment_len);
+    return 0;
+}
+
+
+/**
+ * Builds the display sets: PCS, WDS, PDS, ODS fragments and END, then
+ * decodes the first one to have the object at hand.
+ */
+static int bench_setup(struct bench_data* data) {
+    struct sup_segment_pcs pcs;
+    struct sup_segment_wds wds;
+    struct sup_segment_pds pds;
+    struct sup_segment_ods ods;
+    struct sup_object obj;
+    struct sup_window win;
+    struct sup_color colors[4];
+    unsigned char* rle;
+    unsigned char* segment;
+    size_t rle_len, offset, chunk, set, i, mark;
+    struct sup_packet packet;
+
+    memset(data, 0x00, sizeof(struct bench_data));
+
+    rle = malloc(3 * MICROBENCH_OBJ_WIDTH * MICROBENCH_OBJ_HEIGHT);
+    segment = malloc(SUP_PACKET_MAX_SEGMENT_LEN);
+    if (rle == NULL || segment == NULL) {
+        perror("bench_setup(): malloc()");
+        return -1;
+    }
+    rle_len = bench_encode_object(rle);
+
+    data->stream = malloc(MICROBENCH_STREAM_SETS * (rle_len + 0x1000));
+    if (data->stream == NULL) {
+        perror("bench_setup(): malloc()");
+        return -1;
+    }
+
+    memset(&pcs, 0x00, sizeof(pcs));
+    pcs.video_width = MICROBENCH_VIDEO_WIDTH;
+    pcs.video_height = MICROBENCH_VIDEO_HEIGHT;
+    pcs.frame_rate = SUP_FPS_23_976;
+    pcs.comp_state = SUP_PCS_STATE_EPOCH_START;
+    pcs.num_of_objects = 1;
+    pcs.objects = &obj;
+    memset(&obj, 0x00, sizeof(obj));
+    obj.obj_pos_x = MICROBENCH_OBJ_X;
+    obj.obj_pos_y = MICROBENCH_OBJ_Y;
+
+    wds.num_of_windows = 1;
+    wds.windows = &win;
+    win.win_id = 0;
+    win.x = MICROBENCH_OBJ_X;
+    win.y = MICROBENCH_OBJ_Y;
+    win.width = MICROBENCH_OBJ_WIDTH;
+    win.height = MICROBENCH_OBJ_HEIGHT;
+
+    memset(&pds, 0x00, sizeof(pds));
+    pds.num_of_colors = 4;
+    pds.colors = colors;
+    for (i = 0; i < 4; i++) {
+        colors[i].idx = i;
+        colors[i].y = i == 0 ? 16 : 60 + 60 * i;
+        colors[i].cr = 128;
+        colors[i].cb = 128;
+        colors[i].a = i == 0 ? 0 : 255;
+    }
+
+    memset(&ods, 0x00, sizeof(ods));
+    ods.obj_data_len = rle_len + 4;
+    ods.obj_width = MICROBENCH_OBJ_WIDTH;
+    ods.obj_height = MICROBENCH_OBJ_HEIGHT;
+
+    for (set = 0; set < MICROBENCH_STREAM_SETS; set++) {
+        pcs.comp_id = set;
+
+        mark = data->stream_len;
+        bench_add_packet(data, SUP_SEGMENT_PCS, segment, sup_serialize_segment_pcs(&pcs, segment));
+        if (set == 0 && bench_keep_packet(data, &(data->pcs_packet), mark)) {
+            return -1;
+        }
+
+        mark = data->stream_len;
+        bench_add_packet(data, SUP_SEGMENT_WDS, segment, sup_serialize_segment_wds(&wds, segment));
+        if (set == 0 && bench_keep_packet(data, &(data->wds_packet), mark)) {
+            return -1;
+        }
+
+        mark = data->stream_len;
+        bench_add_packet(data, SUP_SEGMENT_PDS, segment, sup_serialize_segment_pds(&pds, segment));
+        if (set == 0 && bench_keep_packet(data, &(data->pds_packet), mark)) {
+            return -1;
+        }
+
+        for (offset = 0; offset == 0 || offset < rle_len; offset += chunk) {
+            ods.obj_flag = offset == 0 ? SUP_ODS_FIRST : 0x00;
+            chunk = SUP_PACKET_MAX_SEGMENT_LEN -
+                    (offset == 0 ? MICROBENCH_ODS_FIRST_HEADER_LEN : MICROBENCH_ODS_HEADER_LEN);
+            if (chunk >= rle_len - offset) {
+                chunk = rle_len - offset;
+                ods.obj_flag |= SUP_ODS_LAST;
+            }
+            ods.raw_data = rle + offset;
+            ods.raw_data_len = chunk;
+
+            mark = data->stream_len;
+            bench_add_packet(data, SUP_SEGMENT_ODS, segment, sup_serialize_segment_ods(&ods, segment));
+            if (set == 0 && offset == 0 && bench_keep_packet(data, &(data->ods_packet), mark)) {
+                return -1;
+            }
+        }
+
+        bench_add_packet(data, SUP_SEGMENT_END, segment, 0);
+    }
+
+    free(rle);
+    free(segment);
+
+    if ((data->stream_fd = fmemopen(data->stream, data->stream_len, "rb")) == NULL) {
+        perror("bench_setup(): fmemopen()");
+        return -1;
+    }
+
+    /* Decode the first display set, as sup2pgm would. */
+    if (decoder_init(&(data->dec))) {
+        return -1;
+    }
+    packet.segment = NULL;
+    sup_init_packet(&packet);
+    while (!sup_read_packet(data->stream_fd, &packet) && packet.segment_type != SUP_SEGMENT_END) {
+        if (packet.segment_type == SUP_SEGMENT_PCS) {
+            sup_parse_segment_pcs(&packet, data->dec.pcs);
+        } else if (packet.segment_type == SUP_SEGMENT_WDS) {
+            sup_parse_segment_wds(&packet, data->dec.wds);
+        } else if (packet.segment_type == SUP_SEGMENT_PDS) {
+            sup_parse_segment_pds(&packet, data->dec.pds);
+        } else if (packet.segment_type == SUP_SEGMENT_ODS &&
+                   (sup_parse_segment_ods(&packet, data->dec.ods) ||
+                    decoder_add_ods(&(data->dec), data->dec.ods))) {
+            return -1;
+        }
+    }
+    free(packet.segment);
+
+    if ((data->subimg = decoder_find_object(&(data->dec), 0)) == NULL ||
+        sink_find_object(&(data->obj), 0, data->dec.pcs, data->dec.wds)) {
+        fprintf(stderr, "Synthetic caption didn't decode.\n");
+        return -1;
+    }
+
+    canvas_init(&(data->canvas));
+    if (canvas_resize(&(data->canvas), MICROBENCH_VIDEO_WIDTH, MICROBENCH_VIDEO_HEIGHT)) {
+        return -1;
+    }
+    sink_gray_init(&(data->gray_sink), &(data->canvas));
+    data->gray_sink.base.ops->begin_caption(&(data->gray_sink.base), data->dec.pcs, data->dec.pds);
+
+    if ((data->img = malloc(MICROBENCH_VIDEO_WIDTH * MICROBENCH_VIDEO_HEIGHT)) == NULL) {
+        perror("bench_setup(): malloc()");
+        return -1;
+    }
+    memset(data->img, 0x00, MICROBENCH_VIDEO_WIDTH * MICROBENCH_VIDEO_HEIGHT);
+    sink_index_init(&(data->index_sink), data->img, MICROBENCH_VIDEO_WIDTH, MICROBENCH_VIDEO_HEIGHT);
+
+    if ((data->null_fd = fopen("/dev/null", "wb")) == NULL) {
+        perror("bench_setup(): fopen(/dev/null)");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void bench_cleanup(struct bench_data* data) {
+    fclose(data->stream_fd);
+    fclose(data->null_fd);
+    free(data->stream);
+    free(data->pcs_packet.segment);
+    free(data->pds_packet.segment);
+    free(data->wds_packet.segment);
+    free(data->ods_packet.segment);
+    free(data->img);
+    canvas_free(&(data->canvas));
+    decoder_free(&(data->dec));
+}
+
+
+static void run_read_packet(struct bench_data* data) {
+    struct sup_packet* packet = data->dec.packet;
+
+    rewind(data->stream_fd);
+    while (!sup_read_packet(data->stream_fd, packet)) {
+    }
+}
+
+
+static void run_parse_pcs(struct bench_data* data) {
+    sup_parse_segment_pcs(&(data->pcs_packet), data->dec.pcs);
+}
+
+
+static void run_parse_pds(struct bench_data* data) {
+    sup_parse_segment_pds(&(data->pds_packet), data->dec.pds);
+}
+
+
+static void run_parse_wds(struct bench_data* data) {
+    sup_parse_segment_wds(&(data->wds_packet), data->dec.wds);
+}
+
+
+static void run_parse_ods(struct bench_data* data) {
+    sup_parse_segment_ods(&(data->ods_packet), data->dec.ods);
+}
+
+
+/* Sparse canvas, as for PGM output; the window's cleared first. */
+static void run_render_gray(struct bench_data* data) {
+    struct sink* sink = &(data->gray_sink.base);
+
+    sink->ops->render_object(sink, &(data->obj), data->subimg->img, data->subimg->len);
+}
+
+
+/* Dense buffer of raw palette indices. */
+static void run_render_index(struct bench_data* data) {
+    struct sink* sink = &(data->index_sink.base);
+    struct sink_object obj;
+
+    memset(&obj, 0x00, sizeof(obj));
+    sink->ops->render_object(sink, &obj, data->subimg->img, data->subimg->len);
+}
+
+
+static void run_pgm_clear(struct bench_data* data) {
+    pgm_clear(data->img, MICROBENCH_VIDEO_WIDTH, MICROBENCH_VIDEO_HEIGHT);
+}
+
+
+static void run_pgm_clear_region(struct bench_data* data) {
+    pgm_clear_region(data->img, MICROBENCH_VIDEO_WIDTH, MICROBENCH_VIDEO_HEIGHT,
+                     MICROBENCH_OBJ_WIDTH, MICROBENCH_OBJ_HEIGHT,
+                     MICROBENCH_OBJ_X, MICROBENCH_OBJ_Y);
+}
+
+
+static void run_pgm_write(struct bench_data* data) {
+    /* Something to write, pgm_write() refuses blank images. */
+    data->img[0] = 0xff;
+    pgm_write(data->null_fd, data->img, MICROBENCH_VIDEO_WIDTH, MICROBENCH_VIDEO_HEIGHT);
+    fflush(data->null_fd);
+}
+
+
+static unsigned long long bench_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static unsigned long long bench_batch(const struct bench* bench, struct bench_data* data, size_t iterations) {
+    unsigned long long start = bench_now_ns();
+    size_t i;
+
+    for (i = 0; i < iterations; i++) {
+        bench->run(data);
+    }
+
+    return bench_now_ns() - start;
+}
+
+
+static int bench_compare_ns(const void* a, const void* b) {
+    unsigned long long x = *(const unsigned long long*) a,
+                       y = *(const unsigned long long*) b;
+    return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Opens cycles, instructions and cache misses as one group, user space
+ * only.  Leaves ok unset where the kernel doesn't allow it (see
+ * /proc/sys/kernel/perf_event_paranoid) or there's no PMU.
+ */
+static void bench_counters_open(struct bench_counters* counters) {
+    static const uint64_t configs[MICROBENCH_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+    struct perf_event_attr attr;
+    size_t i;
+
+    counters->ok = 0;
+    for (i = 0; i < MICROBENCH_COUNTERS; i++) {
+        counters->fds[i] = -1;
+    }
+
+    for (i = 0; i < MICROBENCH_COUNTERS; i++) {
+        memset(&attr, 0x00, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = i == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+
+        counters->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1,
+                                   i == 0 ? -1 : counters->fds[0], 0);
+        if (counters->fds[i] < 0) {
+            return;
+        }
+    }
+
+    counters->ok = 1;
+}
+
+
+static void bench_counters_close(struct bench_counters* counters) {
+    size_t i;
+
+    for (i = 0; i < MICROBENCH_COUNTERS; i++) {
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+        }
+    }
+}
+
+
+static void bench_counters_start(const struct bench_counters* counters) {
+    if (counters->ok) {
+        ioctl(counters->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counters->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+
+static int bench_counters_stop(const struct bench_counters* counters, uint64_t* values) {
+    uint64_t buf[1 + MICROBENCH_COUNTERS];
+    size_t i;
+
+    if (!counters->ok) {
+        return -1;
+    }
+
+    ioctl(counters->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if (read(counters->fds[0], buf, sizeof(buf)) != sizeof(buf) || buf[0] != MICROBENCH_COUNTERS) {
+        return -1;
+    }
+    for (i = 0; i < MICROBENCH_COUNTERS; i++) {
+        values[i] = buf[1 + i];
+    }
+
+    return 0;
+}
+
+
+static void bench_print_per(const char* name, double value, size_t per) {
+    if (per > 0) {
+        printf(", \"%s\": %.4f", name, value / per);
+    } else {
+        printf(", \"%s\": null", name);
+    }
+}
+
+
+/**
+ * Warms up while finding how many runs make a batch, times reps batches
+ * and prints the median along with the counters, per run.
+ */
+static void bench_run(const struct bench* bench, struct bench_data* data, size_t reps,
+                      struct bench_counters* counters) {
+    static const char* counter_names[MICROBENCH_COUNTERS] = {
+        "cycles", "instructions", "cache_misses"
+    };
+    unsigned long long ns[MICROBENCH_MAX_REPS];
+    size_t iterations = 1, i;
+    uint64_t values[MICROBENCH_COUNTERS];
+    double median;
+    int counted;
+
+    while (bench_batch(bench, data, iterations) < MICROBENCH_MIN_BATCH_NS) {
+        iterations *= 2;
+    }
+    bench_batch(bench, data, iterations);
+
+    bench_counters_start(counters);
+    for (i = 0; i < reps; i++) {
+        ns[i] = bench_batch(bench, data, iterations);
+    }
+    counted = !bench_counters_stop(counters, values);
+
+    qsort(ns, reps, sizeof(unsigned long long), bench_compare_ns);
+    median = (double) ns[reps / 2] / iterations;
+
+    printf("{\"kernel\": \"%s\", \"iterations\": %lu, \"reps\": %lu", bench->name, iterations, reps);
+    printf(", \"ns_per_run\": %.2f, \"ns_min\": %.2f, \"ns_max\": %.2f",
+           median, (double) ns[0] / iterations, (double) ns[reps - 1] / iterations);
+    bench_print_per("ns_per_pixel", median, bench->pixels);
+    bench_print_per("ns_per_packet", median, bench->packets);
+    if (bench->bytes > 0) {
+        printf(", \"mb_per_s\": %.2f", bench->bytes / median * 1e9 / (1024 * 1024));
+    } else {
+        printf(", \"mb_per_s\": null");
+    }
+    for (i = 0; i < MICROBENCH_COUNTERS; i++) {
+        if (counted) {
+            printf(", \"%s\": %.2f", counter_names[i], (double) values[i] / (reps * iterations));
+        } else {
+            printf(", \"%s\": null", counter_names[i]);
+        }
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+
+void print_usage_help(const char* bin) {
+    printf("%s [options] [kernel...]\n\n", bin);
+
+    printf("Runs all kernels, or the ones named, printing a JSON object per line.\n\n");
+
+    printf("Options:\n");
+    printf("  -r <reps>       Time reps batches of each kernel (default: %d).\n", MICROBENCH_DEFAULT_REPS);
+    printf("  -l              List the kernels.\n");
+}
+
+
+/**
+ * Lists the kernels along with what one run of each goes through.
+ */
+static size_t bench_list(const struct bench_data* data, struct bench* benches) {
+    const size_t obj_pixels = MICROBENCH_OBJ_WIDTH * MICROBENCH_OBJ_HEIGHT,
+                 screen_pixels = MICROBENCH_VIDEO_WIDTH * MICROBENCH_VIDEO_HEIGHT;
+    const struct bench list[MICROBENCH_KERNELS] = {
+        {"sup_read_packet", run_read_packet, 0, data->stream_packets, data->stream_len},
+        {"sup_parse_segment_pcs", run_parse_pcs, 0, 1, data->pcs_packet.segment_len},
+        {"sup_parse_segment_pds", run_parse_pds, 0, 1, data->pds_packet.segment_len},
+        {"sup_parse_segment_wds", run_parse_wds, 0, 1, data->wds_packet.segment_len},
+        /* The object data is only pointed at, not gone through. */
+        {"sup_parse_segment_ods", run_parse_ods, 0, 1, MICROBENCH_ODS_FIRST_HEADER_LEN},
+        {"render_gray", run_render_gray, obj_pixels, 0, data->subimg->len},
+        {"render_index", run_render_index, obj_pixels, 0, data->subimg->len},
+        {"pgm_clear", run_pgm_clear, screen_pixels, 0, screen_pixels},
+        {"pgm_clear_region", run_pgm_clear_region, obj_pixels, 0, obj_pixels},
+        {"pgm_write", run_pgm_write, screen_pixels, 0, screen_pixels}
+    };
+
+    memcpy(benches, list, sizeof(list));
+    return MICROBENCH_KERNELS;
+}
+
+
+static int bench_wanted(const char* name, char* const* kernels, size_t kernels_cnt) {
+    size_t i;
+
+    for (i = 0; i < kernels_cnt; i++) {
+        if (!strcmp(kernels[i], name)) {
+            return 1;
+        }
+    }
+
+    return kernels_cnt == 0;
+}
+
+
+int main(int argc, char* argv[]) {
+    struct bench_data data;
+    struct bench_counters counters;
+    struct bench benches[MICROBENCH_KERNELS];
+    char** kernels;
+    size_t i, reps = MICROBENCH_DEFAULT_REPS, kernels_cnt = 0, benches_cnt;
+    uint8_t list = 0;
+
+    if ((kernels = calloc(argc, sizeof(char*))) == NULL) {
+        perror("main(): calloc()");
+        return EXIT_FAILURE;
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "-?")) {
+            print_usage_help(argv[0]);
+            free(kernels);
+            return EXIT_SUCCESS;
+        } else if (!strcmp(argv[i], "-l")) {
+            list = 1;
+        } else if (!strcmp(argv[i], "-r")) {
+            i++;
+            if (i == argc || (reps = strtoul(argv[i], NULL, 10)) == 0 || reps > MICROBENCH_MAX_REPS) {
+                fprintf(stderr, "Please specify 1 to %d repetitions.\n", MICROBENCH_MAX_REPS);
+                free(kernels);
+                return EXIT_FAILURE;
+            }
+        } else {
+            kernels[kernels_cnt++] = argv[i];
+        }
+    }
+
+    if (bench_setup(&data)) {
+        fprintf(stderr, "Failed setting up the benchmarks.\n");
+        free(kernels);
+        return EXIT_FAILURE;
+    }
+    benches_cnt = bench_list(&data, benches);
+
+    if (list) {
+        for (i = 0; i < benches_cnt; i++) {
+            printf("%s\n", benches[i].name);
+        }
+    } else {
+        bench_counters_open(&counters);
+        if (!counters.ok) {
+            fprintf(stderr, "Hardware counters not available, reporting time only.\n");
+        }
+
+        for (i = 0; i < benches_cnt; i++) {
+            if (bench_wanted(benches[i].name, kernels, kernels_cnt)) {
+                bench_run(&(benches[i]), &data, reps, &counters);
+            }
+        }
+
+        bench_counters_close(&counters);
+    }
+
+    bench_cleanup(&data);
+    free(kernels);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,359 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canvas.h"
+#include "mem.h"
+#include "npy.h"
+
+
+static const char* npy_bucket_filename(struct npy_writer* writer, size_t bucket) {
+    sprintf(writer->filename, "%s_w%04lu.npy", writer->base_filename,
+            (unsigned long) NPY_MIN_WIDTH << bucket);
+    return writer->filename;
+}
+
+
+static const char* npy_index_filename(struct npy_writer* writer) {
+    sprintf(writer->filename, "%s_index.npy", writer->base_filename);
+    return writer->filename;
+}
+
+
+/**
+ * Writes the NPY 1.0 header, padded with spaces to NPY_HEADER_LEN.
+ */
+static int npy_write_header(FILE* fd, const char* descr, size_t rows, size_t cols, size_t depth) {
+    char header[NPY_HEADER_LEN + 1];
+    int len;
+
+    if (depth > 0) {
+        len = snprintf(header + 10, NPY_HEADER_LEN - 10,
+                       "{'descr': '%s', 'fortran_order': False, 'shape': (%lu, %lu, %lu), }",
+                       descr, rows, cols, depth);
+    } else {
+        len = snprintf(header + 10, NPY_HEADER_LEN - 10,
+                       "{'descr': '%s', 'fortran_order': False, 'shape': (%lu, %lu), }",
+                       descr, rows, cols);
+    }
+    if (len < 0 || len >= NPY_HEADER_LEN - 10) {
+        return -1;
+    }
+
+    memcpy(header, "\x93NUMPY\x01\x00", 8);
+    header[8] = (NPY_HEADER_LEN - 10) & 0xff;
+    header[9] = (NPY_HEADER_LEN - 10) >> 8;
+    memset(header + 10 + len, ' ', NPY_HEADER_LEN - 10 - len);
+    header[NPY_HEADER_LEN - 1] = '\n';
+
+    if (fwrite(header, NPY_HEADER_LEN, 1, fd) != 1) {
+        perror("npy_write_header(): fwrite()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static FILE* npy_create(const char* filename) {
+    FILE* fd;
+
+    if ((fd = fopen(filename, "wb")) == NULL) {
+        perror("npy_create(): fopen()");
+        return NULL;
+    }
+
+    /* Rows go out in large sequential writes, the header is redone last. */
+    setvbuf(fd, NULL, _IOFBF, NPY_WRITE_BUF_LEN);
+    if (fseek(fd, NPY_HEADER_LEN, SEEK_SET)) {
+        perror("npy_create(): fseek()");
+        fclose(fd);
+        return NULL;
+    }
+
+    return fd;
+}
+
+
+int npy_open(struct npy_writer* writer, const char* base_filename, size_t height) {
+    if (writer == NULL || base_filename == NULL || height == 0) {
+        return -1;
+    }
+
+    memset(writer, 0x00, sizeof(struct npy_writer));
+    writer->base_filename = base_filename;
+    writer->height = height;
+
+    /* "<base>_index.npy", "<base>_w8192.npy" */
+    writer->filename = mem_alloc(strlen(base_filename) + 16);
+    writer->out = mem_alloc(height * NPY_MAX_WIDTH);
+    if (writer->filename == NULL || writer->out == NULL) {
+        perror("npy_open(): malloc()");
+        npy_close(writer);
+        return -1;
+    }
+
+    if ((writer->index.fd = npy_create(npy_index_filename(writer))) == NULL) {
+        npy_close(writer);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Resamples along one axis: area average when shrinking, linear when
+ * growing.  Strides are in elements.
+ */
+static void npy_resample(const float* src, size_t src_len, size_t src_stride,
+                         float* dest, size_t dest_len, size_t dest_stride) {
+    float scale = (float) src_len / dest_len,
+          a, b, sum, pos, f;
+    size_t i, j, j0;
+
+    for (i = 0; i < dest_len; i++) {
+        if (scale >= 1.0f) {
+            a = i * scale;
+            b = a + scale;
+            sum = 0.0f;
+            for (j = (size_t) a; j < src_len && j < b; j++) {
+                /* Coverage of source pixel j by [a, b). */
+                f = (j + 1 < b ? j + 1 : b) - (j > a ? j : a);
+                sum += src[j * src_stride] * f;
+            }
+            dest[i * dest_stride] = sum / scale;
+        } else {
+            pos = (i + 0.5f) * scale - 0.5f;
+            if (pos < 0.0f) {
+                pos = 0.0f;
+            }
+            j0 = (size_t) pos;
+            f = pos - j0;
+            if (j0 + 1 >= src_len) {
+                dest[i * dest_stride] = src[(src_len - 1) * src_stride];
+            } else {
+                dest[i * dest_stride] = src[j0 * src_stride] * (1.0f - f) +
+                                        src[(j0 + 1) * src_stride] * f;
+            }
+        }
+    }
+}
+
+
+/**
+ * Finds the visible pixels' bounding box, copying the area to crop.
+ * Returns -1 if there are none.
+ */
+static int npy_crop(struct npy_writer* writer, const struct canvas* canvas,
+                    const unsigned char** box, size_t* stride,
+                    size_t* x, size_t* y, size_t* width, size_t* height) {
+    size_t x0, y0, x1, y1, cx0, cy0, cx1, cy1, i, j, len;
+    unsigned char* crop;
+    unsigned char* row;
+
+    if (canvas_bounds(canvas, &x0, &y0, &x1, &y1)) {
+        return -1;
+    }
+
+    len = (x1 - x0) * (y1 - y0);
+    if (len > writer->crop_max_len) {
+        if ((crop = mem_realloc(writer->crop, len)) == NULL) {
+            perror("npy_crop(): realloc()");
+            return -1;
+        }
+        writer->crop = crop;
+        writer->crop_max_len = len;
+    }
+
+    cx0 = x1;
+    cy0 = y1;
+    cx1 = x0;
+    cy1 = y0;
+    for (j = y0; j < y1; j++) {
+        row = writer->crop + (j - y0) * (x1 - x0);
+        canvas_copy_span(canvas, j, x0, x1, row);
+        for (i = x0; i < x1; i++) {
+            if (row[i - x0] != 0x00) {
+                cx0 = i < cx0 ? i : cx0;
+                cx1 = i + 1 > cx1 ? i + 1 : cx1;
+                cy0 = j < cy0 ? j : cy0;
+                cy1 = j + 1;
+            }
+        }
+    }
+
+    if (cx1 <= cx0) {
+        return -1;
+    }
+
+    *box = writer->crop + (cy0 - y0) * (x1 - x0) + (cx0 - x0);
+    *stride = x1 - x0;
+    *x = cx0;
+    *y = cy0;
+    *width = cx1 - cx0;
+    *height = cy1 - cy0;
+    return 0;
+}
+
+
+static int npy_grow(float** buf, size_t* max_len, size_t len) {
+    float* new_buf;
+
+    if (len <= *max_len) {
+        return 0;
+    }
+    if ((new_buf = mem_realloc(*buf, len * sizeof(float))) == NULL) {
+        perror("npy_grow(): realloc()");
+        return -1;
+    }
+    *buf = new_buf;
+    *max_len = len;
+    return 0;
+}
+
+
+/**
+ * Appends the caption to its bucket and the index.  Returns -1 if it's
+ * blank.
+ */
+int npy_add(struct npy_writer* writer, const struct canvas* canvas,
+            size_t subtitle_num, uint32_t start_time, uint32_t end_time) {
+    size_t x, y, width, height, stride, scaled_width, bucket, bucket_width, i, j;
+    const unsigned char* crop;
+    float* line;
+    float value;
+    int32_t index[NPY_INDEX_COLUMNS];
+
+    if (npy_crop(writer, canvas, &crop, &stride, &x, &y, &width, &height)) {
+        return -1;
+    }
+
+    scaled_width = (width * writer->height + height / 2) / height;
+    if (scaled_width == 0) {
+        scaled_width = 1;
+    } else if (scaled_width > NPY_MAX_WIDTH) {
+        /* Squeezed into the widest bucket. */
+        scaled_width = NPY_MAX_WIDTH;
+    }
+    for (bucket = 0; (size_t) NPY_MIN_WIDTH << bucket < scaled_width; bucket++) {
+    }
+    bucket_width = (size_t) NPY_MIN_WIDTH << bucket;
+
+    if (npy_grow(&(writer->tmp), &(writer->tmp_max_len), scaled_width * height) ||
+        npy_grow(&(writer->line), &(writer->line_max_len),
+                 width > writer->height ? width : writer->height)) {
+        return -1;
+    }
+    line = writer->line;
+
+    /* Horizontal pass into tmp, height rows of scaled_width. */
+    for (j = 0; j < height; j++) {
+        for (i = 0; i < width; i++) {
+            line[i] = crop[j * stride + i];
+        }
+        npy_resample(line, width, 1, writer->tmp + j * scaled_width, scaled_width, 1);
+    }
+
+    /* Vertical pass, column by column, padded with zeroes on the right. */
+    memset(writer->out, 0x00, writer->height * bucket_width);
+    for (i = 0; i < scaled_width; i++) {
+        npy_resample(writer->tmp + i, height, scaled_width, line, writer->height, 1);
+        for (j = 0; j < writer->height; j++) {
+            value = line[j] + 0.5f;
+            writer->out[j * bucket_width + i] = value < 0.0f ? 0 : value > 255.0f ? 255 : (unsigned char) value;
+        }
+    }
+
+    if (writer->buckets[bucket].fd == NULL &&
+        (writer->buckets[bucket].fd = npy_create(npy_bucket_filename(writer, bucket))) == NULL) {
+        return -1;
+    }
+    if (fwrite(writer->out, writer->height * bucket_width, 1, writer->buckets[bucket].fd) != 1) {
+        perror("npy_add(): fwrite()");
+        return -1;
+    }
+
+    index[0] = subtitle_num;
+    index[1] = start_time;
+    index[2] = end_time;
+    index[3] = x;
+    index[4] = y;
+    index[5] = width;
+    index[6] = height;
+    index[7] = scaled_width;
+    index[8] = bucket_width;
+    index[9] = writer->buckets[bucket].rows;
+    if (fwrite(index, sizeof(index), 1, writer->index.fd) != 1) {
+        perror("npy_add(): fwrite()");
+        return -1;
+    }
+
+    writer->buckets[bucket].rows++;
+    writer->index.rows++;
+
+    return 0;
+}
+
+
+static int npy_little_endian(void) {
+    const uint16_t one = 1;
+    return *(const uint8_t*) &one == 1;
+}
+
+
+static int npy_finish(FILE* fd, const char* descr, size_t rows, size_t cols, size_t depth) {
+    int result = 0;
+
+    if (fseek(fd, 0, SEEK_SET) || npy_write_header(fd, descr, rows, cols, depth)) {
+        result = -1;
+    }
+    if (fclose(fd)) {
+        perror("npy_finish(): fclose()");
+        result = -1;
+    }
+
+    return result;
+}
+
+
+/**
+ * Fills in the arrays' shapes and closes them.
+ */
+int npy_close(struct npy_writer* writer) {
+    size_t i;
+    int result = 0;
+
+    for (i = 0; i < NPY_BUCKETS; i++) {
+        if (writer->buckets[i].fd != NULL &&
+            npy_finish(writer->buckets[i].fd, "|u1", writer->buckets[i].rows,
+                       writer->height, (size_t) NPY_MIN_WIDTH << i)) {
+            fprintf(stderr, "Failed writing %s.\n", npy_bucket_filename(writer, i));
+            result = -1;
+        }
+        writer->buckets[i].fd = NULL;
+    }
+
+    /* Native int32. */
+    if (writer->index.fd != NULL &&
+        npy_finish(writer->index.fd, npy_little_endian() ? "<i4" : ">i4",
+                   writer->index.rows, NPY_INDEX_COLUMNS, 0)) {
+        fprintf(stderr, "Failed writing %s.\n", npy_index_filename(writer));
+        result = -1;
+    }
+    writer->index.fd = NULL;
+
+    free(writer->filename);
+    free(writer->out);
+    free(writer->crop);
+    free(writer->tmp);
+    free(writer->line);
+    writer->filename = NULL;
+    writer->out = NULL;
+    writer->crop = NULL;
+    writer->tmp = NULL;
+    writer->line = NULL;
+
+    return result;
+}
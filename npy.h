@@ -0,0 +1,58 @@
+#ifndef SUP2PGM_NPY_H
+#define SUP2PGM_NPY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "canvas.h"
+
+/* Bucket widths are powers of two from NPY_MIN_WIDTH to NPY_MAX_WIDTH. */
+#define NPY_MIN_WIDTH 64
+#define NPY_MAX_WIDTH 8192
+#define NPY_BUCKETS 8
+
+/* Header space reserved ahead of the data, keeps the data aligned. */
+#define NPY_HEADER_LEN 128
+#define NPY_WRITE_BUF_LEN (1024 * 1024)
+
+/* subtitle, start_ms, end_ms, x, y, width, height, scaled_width, bucket_width, row */
+#define NPY_INDEX_COLUMNS 10
+
+
+struct npy_bucket {
+    FILE* fd;
+    size_t rows;
+};
+
+
+/**
+ * Captions as NumPy arrays for batched OCR: each one is cropped to its
+ * visible pixels, scaled to a fixed height and padded to the next bucket
+ * width, then appended to that bucket's (rows, height, width) uint8
+ * array.  An int32 (rows, NPY_INDEX_COLUMNS) index array tells where
+ * each caption went.  Shapes are filled in when closing.
+ */
+struct npy_writer {
+    const char* base_filename;
+    char* filename;
+    size_t height;
+
+    struct npy_bucket buckets[NPY_BUCKETS];
+    struct npy_bucket index;
+
+    unsigned char* crop;   /* Caption area off the canvas */
+    size_t crop_max_len;
+    float* tmp;            /* Scaled horizontally */
+    size_t tmp_max_len;
+    float* line;           /* One row or column being scaled */
+    size_t line_max_len;
+    unsigned char* out;    /* One bucket wide row block */
+};
+
+
+int npy_open(struct npy_writer* writer, const char* base_filename, size_t height);
+int npy_add(struct npy_writer* writer, const struct canvas* canvas,
+            size_t subtitle_num, uint32_t start_time, uint32_t end_time);
+int npy_close(struct npy_writer* writer);
+
+#endif  /* SUP2PGM_NPY_H */
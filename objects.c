@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "decoder.h"
+#include "mem.h"
+#include "objects.h"
+#include "pgm.h"
+#include "sink.h"
+#include "sup.h"
+
+#define OBJECTS_MIN_TABLE 0x100
+
+
+int objects_init(struct object_store* store, const char* base_filename) {
+    if (store == NULL || base_filename == NULL) {
+        return -1;
+    }
+
+    memset(store, 0x00, sizeof(struct object_store));
+    store->base_filename = base_filename;
+
+    /* "<base>_obj<number>.pgm" */
+    store->filename = mem_alloc(strlen(base_filename) + 30);
+    store->table = mem_calloc(OBJECTS_MIN_TABLE, sizeof(struct object_entry));
+    if (store->filename == NULL || store->table == NULL) {
+        perror("objects_init(): malloc()");
+        objects_free(store);
+        return -1;
+    }
+    store->table_max = OBJECTS_MIN_TABLE;
+
+    return 0;
+}
+
+
+void objects_free(struct object_store* store) {
+    free(store->filename);
+    free(store->table);
+    free(store->img);
+
+    store->filename = NULL;
+    store->table = NULL;
+    store->img = NULL;
+}
+
+
+static struct object_entry* objects_find(const struct object_store* store, uint64_t key) {
+    size_t i = key & (store->table_max - 1);
+
+    while (store->table[i].key != 0 && store->table[i].key != key) {
+        i = (i + 1) & (store->table_max - 1);
+    }
+
+    return &(store->table[i]);
+}
+
+
+/* Keeps the table at most half full. */
+static int objects_grow(struct object_store* store) {
+    struct object_entry* old_table = store->table;
+    size_t i, old_max = store->table_max;
+
+    if ((store->table_cnt + 1) * 2 <= store->table_max) {
+        return 0;
+    }
+
+    if ((store->table = mem_calloc(old_max * 2, sizeof(struct object_entry))) == NULL) {
+        perror("objects_grow(): calloc()");
+        store->table = old_table;
+        return -1;
+    }
+    store->table_max = old_max * 2;
+
+    for (i = 0; i < old_max; i++) {
+        if (old_table[i].key != 0) {
+            *objects_find(store, old_table[i].key) = old_table[i];
+        }
+    }
+
+    free(old_table);
+    return 0;
+}
+
+
+void objects_clear(struct object_store* store) {
+    store->refs_cnt = 0;
+}
+
+
+int objects_set_palette(struct object_store* store, const struct sup_segment_pds* pds) {
+    return sup_palette_lut(pds, SUP_CHANNEL_GRAY, store->lut);
+}
+
+
+/**
+ * Adds an object to the current composition, shown with the palette last
+ * set.
+ */
+int objects_add(struct object_store* store, const struct subimage* subimg,
+                const struct sink_object* placement) {
+    struct object_ref* ref;
+    uint64_t key;
+    uint16_t size[2];
+
+    if (store->refs_cnt == DECODER_MAX_ENTRIES) {
+        return -1;
+    }
+
+    size[0] = subimg->width;
+    size[1] = subimg->height;
+
+    key = cache_hash(0, store->lut, sizeof(store->lut));
+    key = cache_hash(key, size, sizeof(size));
+    key = cache_hash(key, subimg->img, subimg->len);
+
+    ref = &(store->refs[store->refs_cnt++]);
+    ref->obj_id = subimg->obj_id;
+    ref->key = key != 0 ? key : 1;
+    ref->placement = *placement;
+
+    return 0;
+}
+
+
+const char* objects_filename(struct object_store* store, size_t num) {
+    sprintf(store->filename, "%s_obj%05lu.pgm", store->base_filename, num);
+    return store->filename;
+}
+
+
+/**
+ * Returns the image number of the composition's object i, writing it if
+ * it's the first time the object is shown; OBJECTS_INVISIBLE if it's
+ * transparent or couldn't be written.
+ */
+size_t objects_write(struct object_store* store, const struct sup_decoder* dec, size_t i) {
+    const struct object_ref* ref = &(store->refs[i]);
+    const struct subimage* subimg;
+    struct object_entry* entry;
+    struct sink_index sink;
+    struct sink_object obj;
+    unsigned char* img;
+    size_t j, img_len, num = OBJECTS_INVISIBLE;
+    FILE* img_file;
+    int result;
+
+    if (objects_grow(store)) {
+        return OBJECTS_INVISIBLE;
+    }
+
+    entry = objects_find(store, ref->key);
+    if (entry->key == ref->key) {
+        return entry->num;
+    }
+
+    if ((subimg = decoder_find_object(dec, ref->obj_id)) == NULL) {
+        return OBJECTS_INVISIBLE;
+    }
+
+    img_len = (size_t) subimg->width * subimg->height;
+    if (img_len == 0) {
+        return OBJECTS_INVISIBLE;
+    }
+    if (img_len > store->img_max_len) {
+        if ((img = mem_realloc(store->img, img_len)) == NULL) {
+            perror("objects_write(): realloc()");
+            return OBJECTS_INVISIBLE;
+        }
+        store->img = img;
+        store->img_max_len = img_len;
+    }
+
+    memset(&obj, 0x00, sizeof(struct sink_object));
+    obj.obj_id = subimg->obj_id;
+    sink_index_init(&sink, store->img, subimg->width, subimg->height);
+    if (sink.base.ops->render_object(&(sink.base), &obj, subimg->img, subimg->len)) {
+        return OBJECTS_INVISIBLE;
+    }
+
+    for (j = 0; j < img_len; j++) {
+        store->img[j] = store->lut[store->img[j]];
+    }
+
+    if (pgm_max_gray(store->img, subimg->width, subimg->height) != 0x00) {
+        num = store->files_cnt;
+
+        if ((img_file = fopen(objects_filename(store, num), "wb")) == NULL) {
+            perror("objects_write(): fopen()");
+            return OBJECTS_INVISIBLE;
+        }
+        result = pgm_write(img_file, store->img, subimg->width, subimg->height);
+        fclose(img_file);
+        if (result) {
+            return OBJECTS_INVISIBLE;
+        }
+
+        store->files_cnt++;
+    }
+
+    entry->key = ref->key;
+    entry->num = num;
+    store->table_cnt++;
+
+    return num;
+}
@@ -0,0 +1,65 @@
+#ifndef SUP2PGM_OBJECTS_H
+#define SUP2PGM_OBJECTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "decoder.h"
+#include "sink.h"
+#include "sup.h"
+
+/* Table slot of an object that's all transparent, there's no image. */
+#define OBJECTS_INVISIBLE ((size_t) -1)
+
+
+/**
+ * Object shown by the current composition.
+ */
+struct object_ref {
+    uint16_t obj_id;
+    uint64_t key;
+    struct sink_object placement;
+};
+
+
+struct object_entry {
+    uint64_t key;     /* 0 is an empty slot */
+    size_t num;       /* Image number, or OBJECTS_INVISIBLE */
+};
+
+
+/**
+ * Per-object images.  Objects are told apart by a hash of their RLE data
+ * and the palette they're shown with, each one is decoded and written
+ * once, when a caption showing it is saved.
+ */
+struct object_store {
+    const char* base_filename;
+    char* filename;
+
+    struct object_entry* table;  /* Open addressing, power of two long */
+    size_t table_cnt;
+    size_t table_max;
+
+    size_t files_cnt;
+
+    uint8_t lut[0x100];  /* Palette of the current composition */
+    struct object_ref refs[DECODER_MAX_ENTRIES];
+    size_t refs_cnt;
+
+    unsigned char* img;
+    size_t img_max_len;
+};
+
+
+int objects_init(struct object_store* store, const char* base_filename);
+void objects_free(struct object_store* store);
+
+void objects_clear(struct object_store* store);
+int objects_set_palette(struct object_store* store, const struct sup_segment_pds* pds);
+int objects_add(struct object_store* store, const struct subimage* subimg,
+                const struct sink_object* placement);
+size_t objects_write(struct object_store* store, const struct sup_decoder* dec, size_t i);
+const char* objects_filename(struct object_store* store, size_t num);
+
+#endif  /* SUP2PGM_OBJECTS_H */
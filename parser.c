@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+#include "parser.h"
+#include "sup.h"
+
+
+int parser_init(struct push_parser* parser) {
+    if (parser == NULL) {
+        return -1;
+    }
+
+    memset(parser, 0x00, sizeof(struct push_parser));
+
+    if ((parser->segment = mem_alloc(SUP_PACKET_MAX_SEGMENT_LEN)) == NULL) {
+        perror("parser_init(): malloc()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void parser_free(struct push_parser* parser) {
+    free(parser->segment);
+    parser->segment = NULL;
+}
+
+
+/**
+ * Hands the parser the next chunk of input, which has to stay around
+ * until parser_next() has taken all of it.
+ */
+void parser_feed(struct push_parser* parser, const void* chunk, size_t len) {
+    parser->chunk = chunk;
+    parser->chunk_len = len;
+    parser->chunk_pos = 0;
+}
+
+
+/**
+ * Tells whether a partial packet is held, i.e. the input ended early if
+ * there's no more.
+ */
+int parser_pending(const struct push_parser* parser) {
+    return parser->header_len > 0 || parser->in_segment;
+}
+
+
+/**
+ * Returns 1 with the next complete packet, 0 once the chunk is used up,
+ * -1 on a bad packet header (its marker is skipped, same as when reading
+ * from a stream).  packet's segment is set to point to the data, packet
+ * must not own a buffer of its own.
+ */
+int parser_next(struct push_parser* parser, struct sup_packet* packet) {
+    const unsigned char* header;
+    size_t avail = parser->chunk_len - parser->chunk_pos,
+           n;
+
+    if (!parser->in_segment) {
+        if (parser->header_len == 0 && avail >= SUP_PACKET_HEADER_LEN) {
+            header = parser->chunk + parser->chunk_pos;
+        } else {
+            n = SUP_PACKET_HEADER_LEN - parser->header_len;
+            if (n > avail) {
+                n = avail;
+            }
+            memcpy(parser->header + parser->header_len, parser->chunk + parser->chunk_pos, n);
+            parser->header_len += n;
+            parser->chunk_pos += n;
+            avail -= n;
+
+            if (parser->header_len < SUP_PACKET_HEADER_LEN) {
+                return 0;
+            }
+            header = parser->header;
+        }
+
+        if (sup_parse_packet_header(header, &(parser->packet))) {
+            if (header == parser->header) {
+                parser->header_len -= 2;
+                memmove(parser->header, parser->header + 2, parser->header_len);
+            } else {
+                parser->chunk_pos += 2;
+            }
+            parser->offset += 2;
+            return -1;
+        }
+
+        if (header == parser->header) {
+            parser->header_len = 0;
+        } else {
+            parser->chunk_pos += SUP_PACKET_HEADER_LEN;
+            avail -= SUP_PACKET_HEADER_LEN;
+        }
+        parser->in_segment = 1;
+        parser->segment_len = 0;
+    }
+
+    *packet = parser->packet;
+
+    if (parser->segment_len == 0 && avail >= parser->packet.segment_len) {
+        /* All there, no need to copy. */
+        packet->segment = (void*) (parser->chunk + parser->chunk_pos);
+        parser->chunk_pos += parser->packet.segment_len;
+    } else {
+        n = parser->packet.segment_len - parser->segment_len;
+        if (n > avail) {
+            n = avail;
+        }
+        memcpy(parser->segment + parser->segment_len, parser->chunk + parser->chunk_pos, n);
+        parser->segment_len += n;
+        parser->chunk_pos += n;
+
+        if (parser->segment_len < parser->packet.segment_len) {
+            return 0;
+        }
+        packet->segment = parser->segment;
+    }
+
+    parser->in_segment = 0;
+    parser->offset += SUP_PACKET_HEADER_LEN + parser->packet.segment_len;
+
+    return 1;
+}
@@ -0,0 +1,44 @@
+#ifndef SUP2PGM_PARSER_H
+#define SUP2PGM_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sup.h"
+
+
+/**
+ * Push parser: input is fed in chunks of any size, split anywhere, and
+ * packets come out as soon as they're complete.  Nothing ever blocks, so
+ * many streams can be driven from a single event loop.
+ *
+ * A packet lying entirely within the chunk is returned in place, its
+ * segment pointing into the chunk; one split across chunks is put
+ * together in the parser's own buffer.  Either way it stays valid until
+ * the next parser_next() or parser_feed() call.
+ */
+struct push_parser {
+    const unsigned char* chunk;
+    size_t chunk_len;
+    size_t chunk_pos;
+
+    unsigned char header[SUP_PACKET_HEADER_LEN];  /* Partial header */
+    size_t header_len;
+
+    struct sup_packet packet;   /* Header of the packet being put together */
+    uint8_t in_segment;
+    unsigned char* segment;     /* Partial segment */
+    size_t segment_len;
+
+    unsigned long long offset;  /* Of the next packet in the input */
+};
+
+
+int parser_init(struct push_parser* parser);
+void parser_free(struct push_parser* parser);
+
+void parser_feed(struct push_parser* parser, const void* chunk, size_t len);
+int parser_next(struct push_parser* parser, struct sup_packet* packet);
+int parser_pending(const struct push_parser* parser);
+
+#endif  /* SUP2PGM_PARSER_H */
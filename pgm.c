@@ -27,10 +27,8 @@ void pgm_clear_region(unsigned char* img, size_t width, size_t height,
 }
 
 
-int pgm_write(FILE* fd, const unsigned char* img, size_t width, size_t height) {
-    size_t i, n, saved;
-
-    size_t img_len = width * height;
+unsigned char pgm_max_gray(const unsigned char* img, size_t width, size_t height) {
+    size_t i, img_len = width * height;
 
     unsigned char max_gray = 0x00;
 
@@ -40,13 +38,29 @@ int pgm_write(FILE* fd, const unsigned char* img, size_t width, size_t height) {
         }
     }
 
-    if (max_gray == 0x00) {
-        return -1;
-    }
+    return max_gray;
+}
+
 
+void pgm_write_header(FILE* fd, size_t width, size_t height, unsigned char max_gray) {
     fprintf(fd, "P5\n");
     fprintf(fd, "%lu %lu\n", width, height);
     fprintf(fd, "%u\n", max_gray);
+}
+
+
+int pgm_write(FILE* fd, const unsigned char* img, size_t width, size_t height) {
+    size_t n, saved;
+
+    size_t img_len = width * height;
+
+    unsigned char max_gray = pgm_max_gray(img, width, height);
+
+    if (max_gray == 0x00) {
+        return -1;
+    }
+
+    pgm_write_header(fd, width, height, max_gray);
 
     n = 0;
     saved = 0;
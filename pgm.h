@@ -7,6 +7,10 @@ void pgm_clear_region(unsigned char* img, size_t width, size_t height,
                       size_t region_width, size_t region_height,
                       size_t region_x, size_t region_y);
 
+unsigned char pgm_max_gray(const unsigned char* img, size_t width, size_t height);
+
+void pgm_write_header(FILE* fd, size_t width, size_t height, unsigned char max_gray);
+
 int pgm_write(FILE* fd, const unsigned char* img, size_t width, size_t height);
 
 #endif  /* PGM2PGM_PGM_H */
@@ -0,0 +1,194 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <sys/types.h>
+
+#include "decoder.h"
+#include "probe.h"
+#include "srt.h"
+#include "sup.h"
+#include "sup2pgm.h"
+
+/* ODS fields ahead of the RLE data in the first fragment. */
+#define PROBE_ODS_HEADER_LEN 11
+
+
+static int probe_read(FILE* fd, unsigned char* buf, size_t len) {
+    if (len > 0 && fread(buf, len, 1, fd) != 1) {
+        if (ferror(fd)) {
+            perror("probe_read(): fread()");
+        } else {
+            fprintf(stderr, "Unexpected EOF.\n");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Skips len bytes of input, seeking if it's a file.
+ */
+static int probe_skip(FILE* fd, unsigned char* buf, size_t len, uint8_t* seekable) {
+    if (len == 0) {
+        return 0;
+    }
+
+    if (*seekable) {
+        if (!fseeko(fd, len, SEEK_CUR)) {
+            return 0;
+        } else if (errno != ESPIPE) {
+            perror("probe_skip(): fseeko()");
+            return -1;
+        }
+        *seekable = 0;
+    }
+
+    return probe_read(fd, buf, len);
+}
+
+
+static unsigned long long probe_digits(unsigned long long n) {
+    unsigned long long digits = 1;
+
+    for (; n >= 10; n /= 10) {
+        digits++;
+    }
+    return digits;
+}
+
+
+/* Bytes of a saved caption: full size PGM image and .srtx entry. */
+static unsigned long long probe_caption_bytes(const struct probe_summary* summary,
+                                              size_t base_filename_len) {
+    size_t num = summary->captions;
+
+    return strlen("P5\n \n255\n") +
+           probe_digits(summary->video_width) + probe_digits(summary->video_height) +
+           (unsigned long long) summary->video_width * summary->video_height +
+           probe_digits(num + 1) + 1 +
+           2 * SRT_TIMECODE_LEN + strlen(" --> ") + 1 +
+           base_filename_len + (num < 100000 ? 5 : probe_digits(num)) + strlen(".pgm") + 1 +
+           1;
+}
+
+
+/**
+ * Goes through the stream reading packet headers, PCS and the first bytes
+ * of the first ODS fragment of every object; everything else is skipped
+ * (seeked past, if the input is a file) without being copied or decoded.
+ */
+int probe_run(FILE* fd, struct sup_decoder* dec, size_t base_filename_len,
+              struct probe_summary* summary) {
+    struct sup_packet* packet = dec->packet;
+    struct sup_segment_pcs* pcs = dec->pcs;
+    struct sup_segment_ods* ods = dec->ods;
+    unsigned char header[SUP_PACKET_HEADER_LEN];
+    unsigned char* buf;
+    uint32_t start_time = 0, duration;
+    uint8_t shown = 0, seekable = 1;
+    size_t len, n;
+
+    memset(summary, 0x00, sizeof(struct probe_summary));
+
+    if (sup_init_packet(packet)) {
+        return -1;
+    }
+    buf = packet->segment;
+
+    while ((n = fread(header, 1, SUP_PACKET_HEADER_LEN, fd)) == SUP_PACKET_HEADER_LEN) {
+        if (sup_parse_packet_header(header, packet)) {
+            return -1;
+        }
+        summary->packets++;
+        summary->bytes += SUP_PACKET_HEADER_LEN + packet->segment_len;
+
+        if (packet->segment_type == SUP_SEGMENT_PCS) {
+            if (probe_read(fd, buf, packet->segment_len)) {
+                return -1;
+            }
+            if (sup_parse_segment_pcs(packet, pcs)) {
+                continue;
+            }
+
+            summary->display_sets++;
+            if (summary->video_width == 0) {
+                summary->video_width = pcs->video_width;
+                summary->video_height = pcs->video_height;
+                summary->frame_rate = pcs->frame_rate;
+            }
+
+            /* Same as when converting: an epoch start drops what's on screen. */
+            if (pcs->comp_state == SUP_PCS_STATE_EPOCH_START) {
+                summary->epochs++;
+                start_time = pcs->pts_msec;
+            } else if (pcs->pts_msec >= start_time + SUP2PGM_MERGE_THRESHOLD) {
+                if (shown) {
+                    duration = pcs->pts_msec - start_time;
+                    summary->output_bytes += probe_caption_bytes(summary, base_filename_len);
+                    summary->captions++;
+                    summary->total_ms += duration;
+                    if (duration > summary->max_ms) {
+                        summary->max_ms = duration;
+                    }
+                }
+                start_time = pcs->pts_msec;
+            }
+            shown = pcs->num_of_objects > 0;
+
+        } else if (packet->segment_type == SUP_SEGMENT_ODS) {
+            len = packet->segment_len < PROBE_ODS_HEADER_LEN ? packet->segment_len : PROBE_ODS_HEADER_LEN;
+            if (probe_read(fd, buf, len) ||
+                probe_skip(fd, buf + len, packet->segment_len - len, &seekable)) {
+                return -1;
+            }
+
+            /* Only the first fragment tells the object size. */
+            packet->segment_len = len;
+            if (sup_parse_segment_ods(packet, ods) || !(ods->obj_flag & SUP_ODS_FIRST)) {
+                continue;
+            }
+            if ((unsigned long) ods->obj_width * ods->obj_height >
+                (unsigned long) summary->max_obj_width * summary->max_obj_height) {
+                summary->max_obj_width = ods->obj_width;
+                summary->max_obj_height = ods->obj_height;
+            }
+
+        } else if (probe_skip(fd, buf, packet->segment_len, &seekable)) {
+            return -1;
+        }
+    }
+
+    if (n > 0) {
+        fprintf(stderr, "Unexpected EOF.\n");
+    } else if (ferror(fd)) {
+        perror("probe_run(): fread()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void probe_print_json(FILE* fd, const struct probe_summary* summary) {
+    fprintf(fd, "{\n");
+    fprintf(fd, "  \"bytes\": %llu,\n", summary->bytes);
+    fprintf(fd, "  \"packets\": %lu,\n", summary->packets);
+    fprintf(fd, "  \"width\": %u,\n", summary->video_width);
+    fprintf(fd, "  \"height\": %u,\n", summary->video_height);
+    fprintf(fd, "  \"frame_rate\": %.3f,\n", sup_frame_rate_by_id(summary->frame_rate));
+    fprintf(fd, "  \"epochs\": %lu,\n", summary->epochs);
+    fprintf(fd, "  \"display_sets\": %lu,\n", summary->display_sets);
+    fprintf(fd, "  \"captions\": %lu,\n", summary->captions);
+    fprintf(fd, "  \"total_duration_ms\": %llu,\n", summary->total_ms);
+    fprintf(fd, "  \"max_duration_ms\": %u,\n", summary->max_ms);
+    fprintf(fd, "  \"max_object_width\": %u,\n", summary->max_obj_width);
+    fprintf(fd, "  \"max_object_height\": %u,\n", summary->max_obj_height);
+    fprintf(fd, "  \"estimated_output_bytes\": %llu\n", summary->output_bytes);
+    fprintf(fd, "}\n");
+}
@@ -0,0 +1,41 @@
+#ifndef SUP2PGM_PROBE_H
+#define SUP2PGM_PROBE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "decoder.h"
+
+
+/**
+ * What a conversion would produce, told from packet headers and the
+ * fixed-size segment fields alone.  Captions are counted the way they're
+ * saved, a composition showing no object at all is no caption; whether
+ * objects are actually visible isn't known without decoding them.
+ */
+struct probe_summary {
+    unsigned long long bytes;
+    size_t packets;
+    size_t epochs;
+    size_t display_sets;
+    size_t captions;
+
+    uint16_t video_width;
+    uint16_t video_height;
+    uint8_t frame_rate;
+
+    unsigned long long total_ms;
+    uint32_t max_ms;
+
+    uint16_t max_obj_width;   /* Of the largest object */
+    uint16_t max_obj_height;
+
+    unsigned long long output_bytes;  /* PGM images and .srtx */
+};
+
+
+int probe_run(FILE* fd, struct sup_decoder* dec, size_t base_filename_len,
+              struct probe_summary* summary);
+void probe_print_json(FILE* fd, const struct probe_summary* summary);
+
+#endif  /* SUP2PGM_PROBE_H */
@@ -0,0 +1,822 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "mem.h"
+#include "remux.h"
+#include "sink.h"
+#include "sup.h"
+
+/* Longest run a single RLE code can hold. */
+#define REMUX_MAX_RUN 0x3fff
+
+/* Header of the first and of the following ODS fragments. */
+#define REMUX_ODS_FIRST_HEADER_LEN 11
+#define REMUX_ODS_HEADER_LEN 4
+
+
+/* Makes room for cnt items of size len in a growable array. */
+static int remux_grow(void** items, size_t* max_cnt, size_t cnt, size_t len) {
+    size_t new_max_cnt = *max_cnt > 0 ? *max_cnt : 64;
+    void* new_items;
+
+    if (cnt <= *max_cnt) {
+        return 0;
+    }
+
+    while (new_max_cnt < cnt) {
+        new_max_cnt *= 2;
+    }
+    if ((new_items = mem_realloc(*items, new_max_cnt * len)) == NULL) {
+        perror("remux_grow(): realloc()");
+        return -1;
+    }
+
+    *items = new_items;
+    *max_cnt = new_max_cnt;
+    return 0;
+}
+
+
+int remux_init(struct remux* remux, FILE* fd) {
+    if (remux == NULL || fd == NULL) {
+        return -1;
+    }
+
+    memset(remux, 0x00, sizeof(struct remux));
+    remux->fd = fd;
+    remux->last_pcs.objects = remux->last_objects;
+    remux->pds.colors = remux->colors;
+
+    if (decoder_init(&(remux->dec))) {
+        return -1;
+    }
+
+    if ((remux->segment = mem_alloc(SUP_PACKET_MAX_SEGMENT_LEN)) == NULL) {
+        perror("remux_init(): malloc()");
+        decoder_free(&(remux->dec));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void remux_free(struct remux* remux) {
+    decoder_free(&(remux->dec));
+
+    free(remux->buf);
+    free(remux->sets);
+    free(remux->crops);
+    free(remux->placements);
+    free(remux->img);
+    free(remux->rle);
+    free(remux->segment);
+
+    remux->buf = NULL;
+    remux->sets = NULL;
+    remux->crops = NULL;
+    remux->placements = NULL;
+    remux->img = NULL;
+    remux->rle = NULL;
+    remux->segment = NULL;
+}
+
+
+/* Sets up packet for the buffered packet at offset, segment left in place. */
+static int remux_packet_at(struct remux* remux, size_t offset, struct sup_packet* packet) {
+    if (offset + SUP_PACKET_HEADER_LEN > remux->len ||
+        sup_parse_packet_header(remux->buf + offset, packet)) {
+        return -1;
+    }
+
+    packet->segment = remux->buf + offset + SUP_PACKET_HEADER_LEN;
+    return 0;
+}
+
+
+static int remux_write_packet(struct remux* remux, const struct sup_packet* packet) {
+    if (sup_write_packet(remux->fd, packet)) {
+        return -1;
+    }
+
+    remux->bytes_out += SUP_PACKET_HEADER_LEN + packet->segment_len;
+    return 0;
+}
+
+
+static struct remux_crop* remux_find_crop(struct remux* remux, uint16_t obj_id) {
+    size_t i;
+
+    for (i = 0; i < remux->objects_cnt; i++) {
+        if (remux->objects[i].obj_id == obj_id) {
+            return &(remux->objects[i]);
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Decodes the object into remux->img as palette indices. */
+static int remux_decode_object(struct remux* remux, const struct subimage* subimg) {
+    struct sink_index sink;
+    struct sink_object obj;
+    size_t img_len = (size_t) subimg->width * subimg->height;
+
+    if (img_len == 0) {
+        return -1;
+    }
+    if (remux_grow((void**) &(remux->img), &(remux->img_max_len), img_len, 1)) {
+        return -1;
+    }
+
+    memset(&obj, 0x00, sizeof(struct sink_object));
+    obj.obj_id = subimg->obj_id;
+
+    sink_index_init(&sink, remux->img, subimg->width, subimg->height);
+    return sink.base.ops->render_object(&(sink.base), &obj, subimg->img, subimg->len);
+}
+
+
+/**
+ * Refines the palette index classes with another palette: indices stay in
+ * the same class only while they have the same color in every palette.
+ * Transparent colors are all the same.
+ */
+static void remux_add_palette(struct remux* remux, const struct sup_segment_pds* pds) {
+    const struct sup_color* color;
+    uint32_t keys[0x100];
+    uint8_t cls[0x100];
+    size_t i, j, cnt = 0;
+
+    /* Entries needn't be listed in index order, nor all of them. */
+    memset(keys, 0x00, sizeof(keys));
+    for (i = 0; i < pds->num_of_colors; i++) {
+        color = &(pds->colors[i]);
+        if (color->a != 0) {
+            keys[color->idx] = (color->y << 24) | (color->cr << 16) | (color->cb << 8) | color->a;
+            remux->visible[color->idx] = 1;
+        }
+    }
+
+    for (i = 0; i < 0x100; i++) {
+        for (j = 0; j < i; j++) {
+            if (remux->cls[j] == remux->cls[i] && keys[j] == keys[i]) {
+                break;
+            }
+        }
+        cls[i] = j < i ? cls[j] : cnt++;
+    }
+
+    memcpy(remux->cls, cls, sizeof(cls));
+}
+
+
+/**
+ * Leaves the object uncropped and its data as it is, and with it the
+ * palette, the indices it uses being unknown.
+ */
+static void remux_keep_object(struct remux* remux, uint16_t obj_id, uint8_t obj_version,
+                              struct remux_crop* crop) {
+    memset(crop, 0x00, sizeof(struct remux_crop));
+    crop->obj_id = obj_id;
+    crop->obj_version = obj_version;
+    crop->keep = 1;
+    remux->keep_palette = 1;
+}
+
+
+/* Finds the smallest rectangle of the object holding all visible pixels. */
+static void remux_crop_object(struct remux* remux, const struct subimage* subimg,
+                              struct remux_crop* crop) {
+    size_t x, y,
+           x0 = subimg->width, y0 = subimg->height,
+           x1 = 0, y1 = 0;
+    const unsigned char* row;
+
+    for (y = 0; y < subimg->height; y++) {
+        row = remux->img + y * subimg->width;
+        for (x = 0; x < subimg->width; x++) {
+            if (remux->visible[row[x]]) {
+                remux->used[remux->cls[row[x]]] = 1;
+                if (x < x0) {
+                    x0 = x;
+                }
+                if (x >= x1) {
+                    x1 = x + 1;
+                }
+                if (y < y0) {
+                    y0 = y;
+                }
+                y1 = y + 1;
+            }
+        }
+    }
+
+    if (x0 >= x1) {
+        x0 = 0;
+        x1 = 0;
+    }
+    if (y0 >= y1) {
+        y0 = 0;
+        y1 = 0;
+    }
+
+    /* Keep it no smaller than the minimum, without leaving the object. */
+    while (x1 - x0 < REMUX_MIN_OBJECT_SIZE && (x0 > 0 || x1 < subimg->width)) {
+        if (x1 < subimg->width) {
+            x1++;
+        } else {
+            x0--;
+        }
+    }
+    while (y1 - y0 < REMUX_MIN_OBJECT_SIZE && (y0 > 0 || y1 < subimg->height)) {
+        if (y1 < subimg->height) {
+            y1++;
+        } else {
+            y0--;
+        }
+    }
+
+    crop->obj_id = subimg->obj_id;
+    crop->obj_version = subimg->obj_version;
+    crop->keep = 0;
+    crop->x = x0;
+    crop->y = y0;
+    crop->width = x1 - x0;
+    crop->height = y1 - y0;
+}
+
+
+static int remux_pcs_equal(const struct sup_segment_pcs* a, const struct sup_segment_pcs* b) {
+    size_t i;
+
+    if (a->video_width != b->video_width ||
+        a->video_height != b->video_height ||
+        a->frame_rate != b->frame_rate ||
+        a->palette_flag != b->palette_flag ||
+        a->palette_id != b->palette_id ||
+        a->num_of_objects != b->num_of_objects) {
+        return 0;
+    }
+
+    for (i = 0; i < a->num_of_objects; i++) {
+        if (a->objects[i].obj_id != b->objects[i].obj_id ||
+            a->objects[i].win_id != b->objects[i].win_id ||
+            a->objects[i].obj_flag != b->objects[i].obj_flag ||
+            a->objects[i].obj_pos_x != b->objects[i].obj_pos_x ||
+            a->objects[i].obj_pos_y != b->objects[i].obj_pos_y) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Tells whether the segment at offset differs from the one at last_offset. */
+static int remux_segment_changed(const struct remux* remux, size_t offset, size_t len,
+                                 size_t last_offset, size_t last_len) {
+    return last_len == 0 || len != last_len ||
+           memcmp(remux->buf + offset, remux->buf + last_offset, len);
+}
+
+
+static void remux_add_to_window(struct remux* remux, uint8_t win_id,
+                                size_t x, size_t y, const struct remux_crop* crop) {
+    struct remux_window* win = &(remux->windows[win_id]);
+
+    if (crop == NULL) {
+        win->keep = 1;
+        return;
+    }
+
+    if (!win->used) {
+        win->used = 1;
+        win->x0 = x;
+        win->y0 = y;
+        win->x1 = x + crop->width;
+        win->y1 = y + crop->height;
+        return;
+    }
+
+    if (x < win->x0) {
+        win->x0 = x;
+    }
+    if (y < win->y0) {
+        win->y0 = y;
+    }
+    if (x + crop->width > win->x1) {
+        win->x1 = x + crop->width;
+    }
+    if (y + crop->height > win->y1) {
+        win->y1 = y + crop->height;
+    }
+}
+
+
+/**
+ * First pass over the epoch: palettes, object bounds, window bounds and
+ * redundant display sets.
+ */
+static int remux_analyze(struct remux* remux) {
+    struct sup_packet packet;
+    struct sup_decoder* dec = &(remux->dec);
+    struct remux_set* set = NULL;
+    struct remux_crop* crop;
+    struct remux_crop* shown;
+    struct subimage* subimg;
+    size_t i, offset, seg_offset, palette_id;
+    uint8_t changed = 0, stored = 0;
+    struct sup_object* obj;
+
+    memset(remux->cls, 0x00, sizeof(remux->cls));
+    memset(remux->visible, 0x00, sizeof(remux->visible));
+    memset(remux->used, 0x00, sizeof(remux->used));
+    memset(remux->windows, 0x00, sizeof(remux->windows));
+    memset(remux->last_pds_len, 0x00, sizeof(remux->last_pds_len));
+    remux->last_wds_len = 0;
+    remux->keep_palette = 0;
+    remux->have_last = 0;
+    remux->sets_cnt = 0;
+    remux->crops_cnt = 0;
+    remux->placements_cnt = 0;
+
+    /* Palettes first, transparency decides what can be cropped. */
+    for (offset = 0; !remux_packet_at(remux, offset, &packet);
+         offset += SUP_PACKET_HEADER_LEN + packet.segment_len) {
+        if (packet.segment_type == SUP_SEGMENT_PDS &&
+            !sup_parse_segment_pds(&packet, dec->pds)) {
+            remux_add_palette(remux, dec->pds);
+        }
+    }
+
+    decoder_reset_objects(dec);
+    remux->objects_cnt = 0;
+
+    for (offset = 0; !remux_packet_at(remux, offset, &packet);
+         offset += SUP_PACKET_HEADER_LEN + packet.segment_len) {
+        seg_offset = offset + SUP_PACKET_HEADER_LEN;
+
+        if (packet.segment_type == SUP_SEGMENT_PCS) {
+            if (sup_parse_segment_pcs(&packet, dec->pcs)) {
+                set = NULL;
+                continue;
+            }
+
+            if (remux_grow((void**) &(remux->sets), &(remux->sets_max),
+                           remux->sets_cnt + 1, sizeof(struct remux_set))) {
+                return -1;
+            }
+            set = &(remux->sets[remux->sets_cnt]);
+            set->offset = offset;
+            set->len = 0;
+            set->drop = 0;
+            set->crops = remux->crops_cnt;
+            set->placements = remux->placements_cnt;
+            changed = 0;
+
+        } else if (set == NULL) {
+            /* Not part of a display set, passed through as is. */
+            continue;
+
+        } else if (packet.segment_type == SUP_SEGMENT_WDS) {
+            changed |= remux_segment_changed(remux, seg_offset, packet.segment_len,
+                                             remux->last_wds, remux->last_wds_len);
+            remux->last_wds = seg_offset;
+            remux->last_wds_len = packet.segment_len;
+
+        } else if (packet.segment_type == SUP_SEGMENT_PDS) {
+            if (packet.segment_len < 1) {
+                continue;
+            }
+            palette_id = remux->buf[seg_offset];
+            changed |= remux_segment_changed(remux, seg_offset, packet.segment_len,
+                                             remux->last_pds[palette_id],
+                                             remux->last_pds_len[palette_id]);
+            remux->last_pds[palette_id] = seg_offset;
+            remux->last_pds_len[palette_id] = packet.segment_len;
+
+        } else if (packet.segment_type == SUP_SEGMENT_ODS) {
+            if (sup_parse_segment_ods(&packet, dec->ods)) {
+                continue;
+            }
+            stored = !decoder_add_ods(dec, dec->ods);
+            if (!(dec->ods->obj_flag & SUP_ODS_LAST)) {
+                continue;
+            }
+
+            /* Every object gets a crop, the write pass takes one per object. */
+            if (remux_grow((void**) &(remux->crops), &(remux->crops_max),
+                           remux->crops_cnt + 1, sizeof(struct remux_crop))) {
+                return -1;
+            }
+            subimg = stored ? decoder_find_object(dec, dec->ods->obj_id) : NULL;
+            crop = &(remux->crops[remux->crops_cnt++]);
+            if (subimg != NULL && !remux_decode_object(remux, subimg)) {
+                remux_crop_object(remux, subimg, crop);
+            } else {
+                remux_keep_object(remux, dec->ods->obj_id, dec->ods->obj_version, crop);
+            }
+
+            shown = remux_find_crop(remux, crop->obj_id);
+            if (shown == NULL) {
+                if (remux->objects_cnt == DECODER_MAX_OBJECTS) {
+                    /* Not tracked, so placed and written as is. */
+                    remux_keep_object(remux, crop->obj_id, crop->obj_version, crop);
+                    continue;
+                }
+                shown = &(remux->objects[remux->objects_cnt++]);
+                changed = 1;
+            } else if (shown->obj_version != crop->obj_version) {
+                changed = 1;
+            }
+            *shown = *crop;
+
+        } else if (packet.segment_type == SUP_SEGMENT_END) {
+            if (remux_grow((void**) &(remux->placements), &(remux->placements_max),
+                           remux->placements_cnt + dec->pcs->num_of_objects,
+                           sizeof(struct remux_placement))) {
+                return -1;
+            }
+
+            for (i = 0; i < dec->pcs->num_of_objects; i++) {
+                obj = &(dec->pcs->objects[i]);
+                crop = remux_find_crop(remux, obj->obj_id);
+                if (crop != NULL && crop->keep) {
+                    crop = NULL;
+                }
+
+                remux->placements[remux->placements_cnt].x = obj->obj_pos_x + (crop ? crop->x : 0);
+                remux->placements[remux->placements_cnt].y = obj->obj_pos_y + (crop ? crop->y : 0);
+                remux_add_to_window(remux, obj->win_id,
+                                    remux->placements[remux->placements_cnt].x,
+                                    remux->placements[remux->placements_cnt].y,
+                                    crop);
+                remux->placements_cnt++;
+            }
+
+            /* An acquisition point repeating what's on screen adds nothing. */
+            set->drop = remux->have_last && !changed &&
+                        dec->pcs->comp_state == SUP_PCS_STATE_ACQU_POINT &&
+                        remux_pcs_equal(dec->pcs, &(remux->last_pcs));
+            if (!set->drop) {
+                memcpy(remux->last_objects, dec->pcs->objects,
+                       dec->pcs->num_of_objects * sizeof(struct sup_object));
+                remux->last_pcs = *(dec->pcs);
+                remux->last_pcs.objects = remux->last_objects;
+                remux->have_last = 1;
+            }
+
+            set->len = offset + SUP_PACKET_HEADER_LEN + packet.segment_len - set->offset;
+            remux->sets_cnt++;
+            set = NULL;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Numbers the palette index classes used by the objects: the transparent
+ * one becomes color 0 (cheapest to encode), the rest follow.
+ */
+static void remux_merge_palettes(struct remux* remux) {
+    uint8_t new_idx[0x100];
+    size_t i, cls, cnt = 1;
+
+    memset(new_idx, 0x00, sizeof(new_idx));
+    memset(remux->reps, 0x00, sizeof(remux->reps));
+
+    remux->merge = !remux->keep_palette;
+    for (i = 0; i < 0x100 && remux->merge; i++) {
+        cls = remux->cls[i];
+        if (!remux->visible[i] || !remux->used[cls] || new_idx[cls] != 0) {
+            continue;
+        }
+        if (cnt == 0x100) {
+            remux->merge = 0;
+            break;
+        }
+        new_idx[cls] = cnt;
+        remux->reps[cnt] = i;
+        cnt++;
+    }
+
+    for (i = 0; i < 0x100; i++) {
+        if (!remux->merge) {
+            remux->remap[i] = i;
+        } else {
+            remux->remap[i] = remux->visible[i] ? new_idx[remux->cls[i]] : 0;
+        }
+    }
+    remux->num_of_colors = cnt;
+}
+
+
+static void remux_put_run(unsigned char** out, uint8_t color, size_t n) {
+    unsigned char* p = *out;
+
+    if (color == 0x00) {
+        *p++ = 0x00;
+        if (n < 0x40) {
+            *p++ = n;
+        } else {
+            *p++ = 0x40 | (n >> 8);
+            *p++ = n & 0xff;
+        }
+    } else if (n < 3) {
+        while (n--) {
+            *p++ = color;
+        }
+    } else {
+        *p++ = 0x00;
+        if (n < 0x40) {
+            *p++ = 0x80 | n;
+        } else {
+            *p++ = 0xc0 | (n >> 8);
+            *p++ = n & 0xff;
+        }
+        *p++ = color;
+    }
+
+    *out = p;
+}
+
+
+/* Encodes the cropped, remapped object into remux->rle. */
+static size_t remux_encode_object(struct remux* remux, size_t stride,
+                                  const struct remux_crop* crop) {
+    size_t x, y, n;
+    const unsigned char* row;
+    unsigned char* out = remux->rle;
+    uint8_t color;
+
+    for (y = 0; y < crop->height; y++) {
+        row = remux->img + (crop->y + y) * stride + crop->x;
+        for (x = 0; x < crop->width; x += n) {
+            color = remux->remap[row[x]];
+            for (n = 1; x + n < crop->width && n < REMUX_MAX_RUN &&
+                        remux->remap[row[x + n]] == color; n++) {
+            }
+            remux_put_run(&out, color, n);
+        }
+
+        /* 00 00 eq. new line. */
+        *out++ = 0x00;
+        *out++ = 0x00;
+    }
+
+    return out - remux->rle;
+}
+
+
+static int remux_write_object(struct remux* remux, const struct sup_packet* packet,
+                              const struct subimage* subimg, const struct remux_crop* crop) {
+    struct sup_segment_ods ods;
+    struct sup_packet out = *packet;
+    size_t rle_len, offset, chunk;
+
+    if (remux_decode_object(remux, subimg) ||
+        remux_grow((void**) &(remux->rle), &(remux->rle_max_len),
+                   2 * ((size_t) crop->width + 1) * crop->height, 1)) {
+        return -1;
+    }
+
+    rle_len = remux_encode_object(remux, subimg->width, crop);
+    if (rle_len + 4 > 0xffffff) {
+        fprintf(stderr, "Object 0x%04x is too large to re-encode.\n", subimg->obj_id);
+        return -1;
+    }
+
+    ods.obj_id = subimg->obj_id;
+    ods.obj_version = subimg->obj_version;
+    ods.obj_data_len = rle_len + 4;
+    ods.obj_width = crop->width;
+    ods.obj_height = crop->height;
+
+    out.segment = remux->segment;
+    for (offset = 0; offset == 0 || offset < rle_len; offset += chunk) {
+        ods.obj_flag = offset == 0 ? SUP_ODS_FIRST : 0x00;
+        chunk = SUP_PACKET_MAX_SEGMENT_LEN -
+                (offset == 0 ? REMUX_ODS_FIRST_HEADER_LEN : REMUX_ODS_HEADER_LEN);
+        if (chunk >= rle_len - offset) {
+            chunk = rle_len - offset;
+            ods.obj_flag |= SUP_ODS_LAST;
+        }
+
+        ods.raw_data = remux->rle + offset;
+        ods.raw_data_len = chunk;
+        out.segment_len = sup_serialize_segment_ods(&ods, out.segment);
+        if (remux_write_packet(remux, &out)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int remux_write_pds(struct remux* remux, struct sup_packet* packet) {
+    struct sup_segment_pds* pds = remux->dec.pds;
+    struct sup_packet out = *packet;
+    const struct sup_color* by_idx[0x100];
+    size_t i;
+
+    if (!remux->merge || sup_parse_segment_pds(packet, pds)) {
+        return remux_write_packet(remux, packet);
+    }
+
+    memset(by_idx, 0x00, sizeof(by_idx));
+    for (i = 0; i < pds->num_of_colors; i++) {
+        by_idx[pds->colors[i].idx] = &(pds->colors[i]);
+    }
+
+    remux->pds.palette_id = pds->palette_id;
+    remux->pds.num_of_colors = remux->num_of_colors;
+    for (i = 0; i < remux->num_of_colors; i++) {
+        if (i == 0 || by_idx[remux->reps[i]] == NULL) {
+            remux->colors[i].y = 0x10;
+            remux->colors[i].cr = 0x80;
+            remux->colors[i].cb = 0x80;
+            remux->colors[i].a = 0x00;
+        } else {
+            remux->colors[i] = *(by_idx[remux->reps[i]]);
+        }
+        remux->colors[i].idx = i;
+    }
+
+    out.segment = remux->segment;
+    out.segment_len = sup_serialize_segment_pds(&(remux->pds), out.segment);
+    return remux_write_packet(remux, &out);
+}
+
+
+static int remux_write_set(struct remux* remux, const struct remux_set* set) {
+    struct sup_packet packet, out;
+    struct sup_decoder* dec = &(remux->dec);
+    struct remux_window* win;
+    struct remux_crop* crop;
+    struct subimage* subimg;
+    size_t i, offset, crop_idx = set->crops;
+
+    for (offset = set->offset;
+         offset < set->offset + set->len && !remux_packet_at(remux, offset, &packet);
+         offset += SUP_PACKET_HEADER_LEN + packet.segment_len) {
+        out = packet;
+        out.segment = remux->segment;
+
+        if (packet.segment_type == SUP_SEGMENT_PCS) {
+            if (sup_parse_segment_pcs(&packet, dec->pcs)) {
+                return -1;
+            }
+            for (i = 0; i < dec->pcs->num_of_objects; i++) {
+                dec->pcs->objects[i].obj_pos_x = remux->placements[set->placements + i].x;
+                dec->pcs->objects[i].obj_pos_y = remux->placements[set->placements + i].y;
+            }
+            out.segment_len = sup_serialize_segment_pcs(dec->pcs, out.segment);
+
+        } else if (packet.segment_type == SUP_SEGMENT_WDS) {
+            if (sup_parse_segment_wds(&packet, dec->wds)) {
+                return -1;
+            }
+            for (i = 0; i < dec->wds->num_of_windows; i++) {
+                win = &(remux->windows[dec->wds->windows[i].win_id]);
+                if (win->used && !win->keep) {
+                    dec->wds->windows[i].x = win->x0;
+                    dec->wds->windows[i].y = win->y0;
+                    dec->wds->windows[i].width = win->x1 - win->x0;
+                    dec->wds->windows[i].height = win->y1 - win->y0;
+                }
+            }
+            out.segment_len = sup_serialize_segment_wds(dec->wds, out.segment);
+
+        } else if (packet.segment_type == SUP_SEGMENT_PDS) {
+            if (remux_write_pds(remux, &packet)) {
+                return -1;
+            }
+            continue;
+
+        } else if (packet.segment_type == SUP_SEGMENT_ODS) {
+            /* Fragments are collected, the whole object is written at the last one. */
+            if (sup_parse_segment_ods(&packet, dec->ods) || crop_idx >= remux->crops_cnt) {
+                return -1;
+            }
+            crop = &(remux->crops[crop_idx]);
+            if (!crop->keep && decoder_add_ods(dec, dec->ods)) {
+                return -1;
+            }
+            if (dec->ods->obj_flag & SUP_ODS_LAST) {
+                crop_idx++;
+                subimg = decoder_find_object(dec, dec->ods->obj_id);
+                if (!crop->keep && remux_write_object(remux, &packet, subimg, crop)) {
+                    return -1;
+                }
+            }
+            if (!crop->keep) {
+                continue;
+            }
+            /* Fragments of an object kept as is go out unchanged. */
+            out = packet;
+
+        } else {
+            out = packet;
+        }
+
+        if (remux_write_packet(remux, &out)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Writes out the buffered epoch. */
+static int remux_flush(struct remux* remux) {
+    struct sup_packet packet;
+    size_t i, offset, end;
+    int result = 0;
+
+    if (remux->len == 0) {
+        return 0;
+    }
+
+    if (remux_analyze(remux)) {
+        return -1;
+    }
+    remux_merge_palettes(remux);
+
+    decoder_reset_objects(&(remux->dec));
+
+    offset = 0;
+    for (i = 0; i <= remux->sets_cnt && result == 0; i++) {
+        /* Pass through whatever sits between display sets. */
+        end = i < remux->sets_cnt ? remux->sets[i].offset : remux->len;
+        for (; offset < end && !remux_packet_at(remux, offset, &packet);
+             offset += SUP_PACKET_HEADER_LEN + packet.segment_len) {
+            if (remux_write_packet(remux, &packet)) {
+                result = -1;
+                break;
+            }
+        }
+
+        if (i < remux->sets_cnt) {
+            remux->sets_in++;
+            if (!remux->sets[i].drop) {
+                remux->sets_out++;
+                if (remux_write_set(remux, &(remux->sets[i]))) {
+                    fprintf(stderr, "Failed re-muxing display set.\n");
+                    result = -1;
+                }
+            }
+            offset = remux->sets[i].offset + remux->sets[i].len;
+        }
+    }
+
+    remux->len = 0;
+    return result;
+}
+
+
+int remux_add_packet(struct remux* remux, const struct sup_packet* packet) {
+    size_t len = SUP_PACKET_HEADER_LEN + packet->segment_len;
+
+    /* Windows can change at epoch start only, that's where to flush. */
+    if (packet->segment_type == SUP_SEGMENT_PCS &&
+        packet->segment_len > 7 &&
+        ((unsigned char*) packet->segment)[7] == SUP_PCS_STATE_EPOCH_START) {
+        if (remux_flush(remux)) {
+            return -1;
+        }
+    }
+
+    if (remux_grow((void**) &(remux->buf), &(remux->max_len), remux->len + len, 1)) {
+        return -1;
+    }
+
+    sup_serialize_packet_header(packet, remux->buf + remux->len);
+    memcpy(remux->buf + remux->len + SUP_PACKET_HEADER_LEN, packet->segment, packet->segment_len);
+    remux->len += len;
+    remux->bytes_in += len;
+
+    return 0;
+}
+
+
+int remux_finish(struct remux* remux) {
+    if (remux_flush(remux)) {
+        return -1;
+    }
+
+    if (fflush(remux->fd)) {
+        perror("remux_finish(): fflush()");
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef SUP2PGM_REMUX_H
+#define SUP2PGM_REMUX_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "decoder.h"
+#include "sup.h"
+
+/* PGS objects and windows shouldn't be smaller than 8x8. */
+#define REMUX_MIN_OBJECT_SIZE 8
+
+
+/**
+ * Display set (PCS to END) within the buffered epoch.
+ */
+struct remux_set {
+    size_t offset;      /* Of its first packet in the epoch buffer */
+    size_t len;
+    uint8_t drop;       /* Redundant acquisition point */
+    size_t crops;       /* Index of its first object crop */
+    size_t placements;  /* Index of its first composition object position */
+};
+
+
+/**
+ * Visible part of an object.
+ */
+struct remux_crop {
+    uint16_t obj_id;
+    uint8_t obj_version;
+    uint8_t keep;  /* Couldn't be decoded, written as is */
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+
+struct remux_placement {
+    uint16_t x;
+    uint16_t y;
+};
+
+
+struct remux_window {
+    uint8_t used;
+    uint8_t keep;  /* Shows an object of unknown size, leave as is */
+    uint16_t x0;
+    uint16_t y0;
+    uint16_t x1;
+    uint16_t y1;
+};
+
+
+/**
+ * SUP to SUP re-muxer.  Packets are buffered one epoch at a time (windows
+ * can't change within an epoch), then objects are cropped to their visible
+ * bounds and re-encoded, windows shrunk to what's shown in them, palettes
+ * merged and redundant acquisition points dropped.
+ */
+struct remux {
+    FILE* fd;
+    struct sup_decoder dec;
+
+    unsigned char* buf;
+    size_t len;
+    size_t max_len;
+
+    struct remux_set* sets;
+    size_t sets_cnt;
+    size_t sets_max;
+
+    struct remux_crop* crops;
+    size_t crops_cnt;
+    size_t crops_max;
+
+    struct remux_placement* placements;
+    size_t placements_cnt;
+    size_t placements_max;
+
+    /* Current object crops while walking the epoch. */
+    struct remux_crop objects[DECODER_MAX_OBJECTS];
+    size_t objects_cnt;
+
+    /* Palette merging: equivalence classes of indices over all PDS. */
+    uint8_t cls[0x100];
+    uint8_t visible[0x100];
+    uint8_t used[0x100];
+    uint8_t remap[0x100];
+    uint8_t reps[0x100];
+    size_t num_of_colors;
+    uint8_t merge;
+    uint8_t keep_palette;  /* Some object keeps its original colors */
+
+    struct remux_window windows[0x100];
+
+    /* Redundancy checks. */
+    uint8_t have_last;
+    struct sup_segment_pcs last_pcs;
+    struct sup_object last_objects[0x100];
+    size_t last_wds;
+    size_t last_wds_len;
+    size_t last_pds[0x100];
+    size_t last_pds_len[0x100];
+
+    struct sup_segment_pds pds;
+    struct sup_color colors[0x100];
+
+    unsigned char* img;
+    size_t img_max_len;
+    unsigned char* rle;
+    size_t rle_max_len;
+    unsigned char* segment;
+
+    unsigned long sets_in;
+    unsigned long sets_out;
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+};
+
+
+int remux_init(struct remux* remux, FILE* fd);
+int remux_add_packet(struct remux* remux, const struct sup_packet* packet);
+int remux_finish(struct remux* remux);
+void remux_free(struct remux* remux);
+
+#endif  /* SUP2PGM_REMUX_H */
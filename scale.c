@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canvas.h"
+#include "mem.h"
+#include "scale.h"
+
+
+void scaler_init(struct scaler* scaler) {
+    memset(scaler, 0x00, sizeof(struct scaler));
+}
+
+
+void scaler_free(struct scaler* scaler) {
+    if (scaler->img != scaler->mid) {
+        free(scaler->img);
+    }
+    free(scaler->mid);
+    free(scaler->row);
+    free(scaler->sums);
+
+    scaler_init(scaler);
+}
+
+
+int scaler_resize(struct scaler* scaler, size_t src_width, size_t src_height,
+                  size_t width, size_t height) {
+    size_t factor;
+
+    scaler_free(scaler);
+
+    /* Down only. */
+    if (width == 0 || height == 0 || width > src_width || height > src_height) {
+        return -1;
+    }
+
+    factor = src_width / width < src_height / height ? src_width / width : src_height / height;
+
+    scaler->src_width = src_width;
+    scaler->src_height = src_height;
+    scaler->width = width;
+    scaler->height = height;
+    scaler->factor = factor;
+    scaler->mid_width = (src_width + factor - 1) / factor;
+    scaler->mid_height = (src_height + factor - 1) / factor;
+
+    scaler->mid = mem_alloc(scaler->mid_width * scaler->mid_height);
+    scaler->row = mem_calloc(scaler->mid_width * factor, 1);
+    scaler->sums = mem_alloc(scaler->mid_width * sizeof(uint32_t));
+    if (scaler->mid_width == width && scaler->mid_height == height) {
+        scaler->img = scaler->mid;
+    } else {
+        scaler->img = mem_alloc(width * height);
+    }
+
+    if (scaler->mid == NULL || scaler->row == NULL ||
+        scaler->sums == NULL || scaler->img == NULL) {
+        perror("scaler_resize(): malloc()");
+        scaler_free(scaler);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Averages factor x factor blocks of [x0, x1) by [y0, y1) into mid.
+ * Past the canvas edges reads as zero.
+ */
+static void scaler_box(struct scaler* scaler, const struct canvas* canvas,
+                       size_t x0, size_t y0, size_t x1, size_t y1) {
+    size_t f = scaler->factor,
+           area = f * f,
+           bx0 = x0 / f,
+           bx1 = (x1 + f - 1) / f,
+           by0 = y0 / f,
+           by1 = (y1 + f - 1) / f,
+           xs = bx0 * f,
+           xe = bx1 * f < scaler->src_width ? bx1 * f : scaler->src_width,
+           bx, by, j, y;
+    const unsigned char* src;
+    unsigned char* dest;
+    uint32_t* sums = scaler->sums;
+
+    if (f == 1) {
+        for (y = y0; y < y1; y++) {
+            canvas_copy_span(canvas, y, x0, x1, scaler->mid + y * scaler->mid_width + x0);
+        }
+        return;
+    }
+
+    for (by = by0; by < by1; by++) {
+        memset(sums + bx0, 0x00, (bx1 - bx0) * sizeof(uint32_t));
+
+        for (y = by * f; y < by * f + f && y < scaler->src_height; y++) {
+            canvas_copy_span(canvas, y, xs, xe, scaler->row + xs);
+
+            /* Plain loops over plain arrays, left for the compiler to vectorize. */
+            if (f == 2) {
+                src = scaler->row;
+                for (bx = bx0; bx < bx1; bx++) {
+                    sums[bx] += src[2 * bx] + src[2 * bx + 1];
+                }
+            } else {
+                for (bx = bx0; bx < bx1; bx++) {
+                    src = scaler->row + bx * f;
+                    for (j = 0; j < f; j++) {
+                        sums[bx] += src[j];
+                    }
+                }
+            }
+        }
+
+        dest = scaler->mid + by * scaler->mid_width;
+        for (bx = bx0; bx < bx1; bx++) {
+            dest[bx] = (sums[bx] + area / 2) / area;
+        }
+    }
+}
+
+
+/* Maps an output coordinate to the 16.16 fixed point source one. */
+static size_t scaler_src_pos(size_t pos, size_t step) {
+    size_t center = pos * step + step / 2;
+    return center > 0x8000 ? center - 0x8000 : 0;
+}
+
+
+/**
+ * Bilinear from mid to img, over the output pixels [bx0, bx1) by [by0, by1)
+ * of mid can reach.
+ */
+static void scaler_bilinear(struct scaler* scaler, size_t bx0, size_t by0, size_t bx1, size_t by1) {
+    size_t mid_width = scaler->mid_width,
+           mid_height = scaler->mid_height,
+           width = scaler->width,
+           height = scaler->height,
+           step_x = (mid_width << 16) / width,
+           step_y = (mid_height << 16) / height,
+           ox0 = bx0 * width / mid_width,
+           ox1 = (bx1 * width + mid_width - 1) / mid_width + 1,
+           oy0 = by0 * height / mid_height,
+           oy1 = (by1 * height + mid_height - 1) / mid_height + 1,
+           ox, oy, sx, sy, ix, iy, ix1, iy1;
+    uint32_t fx, fy, top, bottom;
+    const unsigned char* r0;
+    const unsigned char* r1;
+    unsigned char* dest;
+
+    ox0 = ox0 > 0 ? ox0 - 1 : 0;
+    oy0 = oy0 > 0 ? oy0 - 1 : 0;
+    ox1 = ox1 < width ? ox1 : width;
+    oy1 = oy1 < height ? oy1 : height;
+
+    for (oy = oy0; oy < oy1; oy++) {
+        sy = scaler_src_pos(oy, step_y);
+        iy = sy >> 16;
+        if (iy >= mid_height) {
+            iy = mid_height - 1;
+        }
+        iy1 = iy + 1 < mid_height ? iy + 1 : iy;
+        fy = (sy >> 8) & 0xff;
+
+        r0 = scaler->mid + iy * mid_width;
+        r1 = scaler->mid + iy1 * mid_width;
+        dest = scaler->img + oy * width;
+
+        for (ox = ox0; ox < ox1; ox++) {
+            sx = scaler_src_pos(ox, step_x);
+            ix = sx >> 16;
+            if (ix >= mid_width) {
+                ix = mid_width - 1;
+            }
+            ix1 = ix + 1 < mid_width ? ix + 1 : ix;
+            fx = (sx >> 8) & 0xff;
+
+            top = r0[ix] * (256 - fx) + r0[ix1] * fx;
+            bottom = r1[ix] * (256 - fx) + r1[ix1] * fx;
+            dest[ox] = (top * (256 - fy) + bottom * fy + 0x8000) >> 16;
+        }
+    }
+}
+
+
+/**
+ * Scales the canvas into scaler->img.
+ */
+void scaler_run(struct scaler* scaler, const struct canvas* canvas) {
+    size_t x0, y0, x1, y1, f = scaler->factor;
+
+    memset(scaler->mid, 0x00, scaler->mid_width * scaler->mid_height);
+    if (scaler->img != scaler->mid) {
+        memset(scaler->img, 0x00, scaler->width * scaler->height);
+    }
+
+    if (canvas_bounds(canvas, &x0, &y0, &x1, &y1)) {
+        return;
+    }
+
+    scaler_box(scaler, canvas, x0, y0, x1, y1);
+
+    if (scaler->img != scaler->mid) {
+        scaler_bilinear(scaler, x0 / f, y0 / f, (x1 + f - 1) / f, (y1 + f - 1) / f);
+    }
+}
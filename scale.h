@@ -0,0 +1,39 @@
+#ifndef SUP2PGM_SCALE_H
+#define SUP2PGM_SCALE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "canvas.h"
+
+
+/**
+ * Canvas downscaler: a box filter by the largest whole factor that fits,
+ * then bilinear down to the exact size if there's anything left to do.
+ * Only the area covered by live tiles is filtered.
+ */
+struct scaler {
+    size_t src_width;
+    size_t src_height;
+    size_t width;
+    size_t height;
+
+    size_t factor;
+    size_t mid_width;    /* Box filter output */
+    size_t mid_height;
+    unsigned char* mid;
+
+    unsigned char* img;  /* Output, same as mid if there's no bilinear pass */
+    unsigned char* row;  /* Source rows, mid_width * factor long */
+    uint32_t* sums;
+};
+
+
+void scaler_init(struct scaler* scaler);
+int scaler_resize(struct scaler* scaler, size_t src_width, size_t src_height,
+                  size_t width, size_t height);
+void scaler_free(struct scaler* scaler);
+
+void scaler_run(struct scaler* scaler, const struct canvas* canvas);
+
+#endif  /* SUP2PGM_SCALE_H */
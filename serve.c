@@ -0,0 +1,375 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "serve.h"
+
+
+static volatile sig_atomic_t serve_stopping = 0;
+
+
+static void serve_stop(int sig) {
+    serve_stopping = 1;
+}
+
+
+static unsigned long serve_elapsed_ms(const struct timespec* since) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 +
+           (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+
+static int serve_listen(const char* path) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long.\n", path);
+        return -1;
+    }
+
+    /* Left over from a previous run. */
+    if (!stat(path, &st) && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        perror("serve_listen(): socket()");
+        return -1;
+    }
+
+    memset(&addr, 0x00, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(struct sockaddr_un))) {
+        perror("serve_listen(): bind()");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN)) {
+        perror("serve_listen(): listen()");
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/**
+ * Receives the request line and the input stream, if one is passed along
+ * (SCM_RIGHTS).  The stream is closed again if the request is bad.
+ */
+static int serve_recv_request(int conn, char* buf, int* input_fd) {
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    size_t len = 0;
+    ssize_t n;
+    int fd;
+    char* eol = NULL;
+
+    *input_fd = -1;
+
+    while (eol == NULL && len < SERVE_MAX_REQUEST_LEN - 1) {
+        iov.iov_base = buf + len;
+        iov.iov_len = SERVE_MAX_REQUEST_LEN - 1 - len;
+
+        memset(&msg, 0x00, sizeof(struct msghdr));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        if ((n = recvmsg(conn, &msg, 0)) < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+                if (*input_fd < 0) {
+                    *input_fd = fd;
+                } else {
+                    close(fd);
+                }
+            }
+        }
+
+        len += n;
+        buf[len] = '\0';
+        eol = strchr(buf, '\n');
+    }
+
+    if (eol == NULL) {
+        if (*input_fd >= 0) {
+            close(*input_fd);
+            *input_fd = -1;
+        }
+        return -1;
+    }
+
+    *eol = '\0';
+    return 0;
+}
+
+
+static void serve_stats_done(struct serve_stats* stats, int status, unsigned long ms) {
+    uint64_t max_ms = __atomic_load_n(&(stats->max_ms), __ATOMIC_RELAXED);
+
+    __atomic_sub_fetch(&(stats->active), 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&(stats->jobs), 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&(stats->busy_ms), ms, __ATOMIC_RELAXED);
+    if (status != 0) {
+        __atomic_add_fetch(&(stats->failed), 1, __ATOMIC_RELAXED);
+    }
+    while (ms > max_ms &&
+           !__atomic_compare_exchange_n(&(stats->max_ms), &max_ms, ms, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+
+/**
+ * Runs the job with stdout and stderr sent to the client.
+ */
+static int serve_job(int conn, int argc, char* argv[], FILE* input, serve_job_fn job, void* ctx) {
+    int saved_stdout, saved_stderr, status;
+
+    fflush(stdout);
+    fflush(stderr);
+    if ((saved_stdout = dup(STDOUT_FILENO)) < 0 ||
+        (saved_stderr = dup(STDERR_FILENO)) < 0) {
+        perror("serve_job(): dup()");
+        if (saved_stdout >= 0) {
+            close(saved_stdout);
+        }
+        if (input != NULL) {
+            fclose(input);
+        }
+        return -1;
+    }
+    dup2(conn, STDOUT_FILENO);
+    dup2(conn, STDERR_FILENO);
+
+    status = job(argc, argv, input, ctx);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+
+    return status;
+}
+
+
+static void serve_conn(int conn, struct serve_stats* stats, serve_job_fn job, void* ctx) {
+    char request[SERVE_MAX_REQUEST_LEN];
+    char* argv[SERVE_MAX_ARGS + 1];
+    int argc = 0, input_fd, status;
+    FILE* input = NULL;
+    char* arg;
+    struct timespec started;
+    unsigned long ms;
+
+    if (serve_recv_request(conn, request, &input_fd)) {
+        dprintf(conn, "error bad request\n");
+        return;
+    }
+
+    /* Tab-separated words, the first one is the command. */
+    for (arg = strtok(request, "\t"); arg != NULL && argc < SERVE_MAX_ARGS; arg = strtok(NULL, "\t")) {
+        argv[argc++] = arg;
+    }
+
+    if (argc > 0 && !strcmp(argv[0], "stats")) {
+        dprintf(conn, "stats workers %u active %u jobs %llu failed %llu busy_ms %llu max_ms %llu\n",
+                (unsigned int) stats->workers,
+                (unsigned int) __atomic_load_n(&(stats->active), __ATOMIC_RELAXED),
+                (unsigned long long) __atomic_load_n(&(stats->jobs), __ATOMIC_RELAXED),
+                (unsigned long long) __atomic_load_n(&(stats->failed), __ATOMIC_RELAXED),
+                (unsigned long long) __atomic_load_n(&(stats->busy_ms), __ATOMIC_RELAXED),
+                (unsigned long long) __atomic_load_n(&(stats->max_ms), __ATOMIC_RELAXED));
+
+    } else if (argc > 0 && !strcmp(argv[0], "convert")) {
+        /* Read the stream as it is, pipes and sockets too, from where the client left it. */
+        if (input_fd >= 0) {
+            if ((input = fdopen(input_fd, "rb")) == NULL) {
+                perror("serve_conn(): fdopen()");
+                dprintf(conn, "error bad input\n");
+                close(input_fd);
+                return;
+            }
+            input_fd = -1;
+        }
+        argv[argc] = NULL;
+
+        __atomic_add_fetch(&(stats->active), 1, __ATOMIC_RELAXED);
+        clock_gettime(CLOCK_MONOTONIC, &started);
+
+        status = serve_job(conn, argc, argv, input, job, ctx);
+
+        ms = serve_elapsed_ms(&started);
+        serve_stats_done(stats, status, ms);
+        dprintf(conn, "done %d %lu\n", status, ms);
+
+    } else {
+        dprintf(conn, "error unknown request\n");
+    }
+
+    if (input_fd >= 0) {
+        close(input_fd);
+    }
+}
+
+
+static void serve_worker(int listen_fd, struct serve_stats* stats, serve_job_fn job, void* ctx) {
+    int conn;
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    for (;;) {
+        if ((conn = accept(listen_fd, NULL, NULL)) < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("serve_worker(): accept()");
+            return;
+        }
+
+        serve_conn(conn, stats, job, ctx);
+        close(conn);
+    }
+}
+
+
+/**
+ * Pre-forks a pool of workers taking turns accepting connections on the
+ * socket, each runs one job at a time.  Whatever's set up before the call
+ * (ctx) is inherited by every worker, so there's nothing left to allocate
+ * or warm up per job.  Workers that die are replaced.  Returns on SIGINT
+ * or SIGTERM.
+ */
+int serve_run(const char* path, size_t workers, serve_job_fn job, void* ctx) {
+    struct serve_stats* stats;
+    struct sigaction action;
+    pid_t* pids;
+    pid_t pid;
+    size_t i;
+    int listen_fd, zero_fd;
+
+    if (path == NULL || workers == 0 || job == NULL) {
+        return -1;
+    }
+
+    if ((pids = calloc(workers, sizeof(pid_t))) == NULL) {
+        perror("serve_run(): calloc()");
+        return -1;
+    }
+
+    /* Counters shared by the workers. */
+    if ((zero_fd = open("/dev/zero", O_RDWR)) < 0) {
+        perror("serve_run(): open(/dev/zero)");
+        free(pids);
+        return -1;
+    }
+    stats = mmap(NULL, sizeof(struct serve_stats), PROT_READ | PROT_WRITE, MAP_SHARED, zero_fd, 0);
+    close(zero_fd);
+    if (stats == MAP_FAILED) {
+        perror("serve_run(): mmap()");
+        free(pids);
+        return -1;
+    }
+    stats->workers = workers;
+
+    if ((listen_fd = serve_listen(path)) < 0) {
+        munmap(stats, sizeof(struct serve_stats));
+        free(pids);
+        return -1;
+    }
+
+    memset(&action, 0x00, sizeof(struct sigaction));
+    action.sa_handler = serve_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    while (!serve_stopping) {
+        for (i = 0; i < workers; i++) {
+            if (pids[i] != 0) {
+                continue;
+            }
+
+            if ((pid = fork()) < 0) {
+                perror("serve_run(): fork()");
+            } else if (pid == 0) {
+                serve_worker(listen_fd, stats, job, ctx);
+                _exit(EXIT_FAILURE);
+            } else {
+                pids[i] = pid;
+            }
+        }
+
+        if ((pid = wait(NULL)) > 0) {
+            for (i = 0; i < workers; i++) {
+                if (pids[i] == pid) {
+                    pids[i] = 0;
+                }
+            }
+            if (!serve_stopping) {
+                fprintf(stderr, "Worker %ld died, restarting.\n", (long) pid);
+            }
+        } else if (errno == ECHILD) {
+            /* Couldn't fork any, don't spin. */
+            sleep(1);
+        }
+    }
+
+    for (i = 0; i < workers; i++) {
+        if (pids[i] != 0) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+    while (wait(NULL) > 0 || errno == EINTR) {
+    }
+
+    close(listen_fd);
+    unlink(path);
+    munmap(stats, sizeof(struct serve_stats));
+    free(pids);
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef SUP2PGM_SERVE_H
+#define SUP2PGM_SERVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SERVE_DEFAULT_WORKERS 4
+#define SERVE_MAX_REQUEST_LEN 4096
+#define SERVE_MAX_ARGS 64
+
+
+/**
+ * Pool-wide counters, shared by all the workers.
+ */
+struct serve_stats {
+    uint32_t workers;
+    uint32_t active;       /* Jobs being run right now */
+    uint64_t jobs;         /* Jobs done */
+    uint64_t failed;       /* Jobs done with non-zero status */
+    uint64_t busy_ms;      /* Time spent running jobs */
+    uint64_t max_ms;       /* Longest job */
+};
+
+
+/**
+ * Runs one job: argv as if on the command line, input the stream passed
+ * along with the request (NULL if there's none), to be closed by the job.
+ * Output goes to stdout and stderr, which are the client's connection
+ * while the job runs.
+ */
+typedef int (*serve_job_fn)(int argc, char* argv[], FILE* input, void* ctx);
+
+
+int serve_run(const char* path, size_t workers, serve_job_fn job, void* ctx);
+
+#endif  /* SUP2PGM_SERVE_H */
@@ -0,0 +1,304 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+#define SHM_RECORD_ALIGN sizeof(struct shm_caption)
+
+/* Polling backoff while waiting on the other side, in nanoseconds. */
+#define SHM_BACKOFF_MIN 1000
+#define SHM_BACKOFF_MAX 1000000
+
+
+static void shm_backoff(long* ns) {
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = *ns;
+    nanosleep(&ts, NULL);
+
+    if (*ns < SHM_BACKOFF_MAX) {
+        *ns *= 2;
+    }
+}
+
+
+static int shm_ring_map(struct shm_ring* ring, size_t map_len) {
+    void* addr;
+
+    addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("shm_ring_map(): mmap()");
+        return -1;
+    }
+
+    ring->map_len = map_len;
+    ring->hdr = addr;
+    ring->data = (unsigned char*) addr + sizeof(struct shm_ring_header);
+
+    return 0;
+}
+
+
+int shm_ring_create(struct shm_ring* ring, const char* name, size_t size) {
+    size = size - size % SHM_RECORD_ALIGN;
+    if (ring == NULL || name == NULL || size == 0) {
+        return -1;
+    }
+
+    ring->hdr = NULL;
+    ring->abandoned = 0;
+    if ((ring->fd = shm_open(name, O_CREAT | O_RDWR, 0600)) < 0) {
+        perror("shm_ring_create(): shm_open()");
+        return -1;
+    }
+    if (ftruncate(ring->fd, sizeof(struct shm_ring_header) + size)) {
+        perror("shm_ring_create(): ftruncate()");
+        close(ring->fd);
+        return -1;
+    }
+    if (shm_ring_map(ring, sizeof(struct shm_ring_header) + size)) {
+        close(ring->fd);
+        return -1;
+    }
+
+    /* Invalidate a leftover ring before resetting it. */
+    __atomic_store_n(&(ring->hdr->magic), 0, __ATOMIC_RELEASE);
+
+    ring->hdr->version = SHM_RING_VERSION;
+    ring->hdr->size = size;
+    ring->hdr->head = 0;
+    ring->hdr->tail = 0;
+    ring->hdr->closed = 0;
+    ring->hdr->consumer = 0;
+
+    /* The magic tells the consumer the rest of the header is valid. */
+    __atomic_store_n(&(ring->hdr->magic), SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+
+/**
+ * Waits until there is room for len contiguous bytes at head,
+ * i.e. applies backpressure when the consumer falls behind.  Gives up if
+ * the consumer is gone or none attaches within SHM_ATTACH_TIMEOUT_MS.
+ */
+static int shm_ring_reserve(struct shm_ring* ring, uint64_t head, size_t len) {
+    long backoff = SHM_BACKOFF_MIN;
+    struct timespec since, now;
+    uint64_t tail;
+    pid_t consumer;
+
+    clock_gettime(CLOCK_MONOTONIC, &since);
+
+    while (1) {
+        tail = __atomic_load_n(&(ring->hdr->tail), __ATOMIC_ACQUIRE);
+        if (ring->hdr->size - (head - tail) >= len) {
+            return 0;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        consumer = __atomic_load_n(&(ring->hdr->consumer), __ATOMIC_ACQUIRE);
+        if (consumer != 0 && kill(consumer, 0) && errno == ESRCH) {
+            fprintf(stderr, "Ring buffer consumer %d is gone.\n", (int) consumer);
+            ring->abandoned = 1;
+            return -1;
+        } else if (consumer != 0) {
+            since = now;
+        } else if ((now.tv_sec - since.tv_sec) * 1000 +
+                   (now.tv_nsec - since.tv_nsec) / 1000000 >= SHM_ATTACH_TIMEOUT_MS) {
+            fprintf(stderr, "No ring buffer consumer attached in %d s.\n",
+                    SHM_ATTACH_TIMEOUT_MS / 1000);
+            ring->abandoned = 1;
+            return -1;
+        }
+
+        shm_backoff(&backoff);
+    }
+}
+
+
+/**
+ * Reserves a record for the caption and returns where its pixels go;
+ * nothing is visible to the consumer until shm_ring_commit().
+ */
+unsigned char* shm_ring_begin(struct shm_ring* ring, const struct shm_caption* caption) {
+    struct shm_caption* rec;
+    uint64_t head = ring->hdr->head;
+    size_t pos, len;
+
+    if (ring->abandoned) {
+        return NULL;
+    }
+
+    len = sizeof(struct shm_caption) + (size_t) caption->width * caption->height;
+    len = (len + SHM_RECORD_ALIGN - 1) / SHM_RECORD_ALIGN * SHM_RECORD_ALIGN;
+    if (len > ring->hdr->size) {
+        fprintf(stderr, "Caption doesn't fit into the ring buffer.\n");
+        return NULL;
+    }
+
+    pos = head % ring->hdr->size;
+    if (pos + len > ring->hdr->size) {
+        /* Not enough room till the end: pad and wrap around. */
+        if (shm_ring_reserve(ring, head, ring->hdr->size - pos)) {
+            return NULL;
+        }
+
+        rec = (struct shm_caption*) (ring->data + pos);
+        memset(rec, 0x00, sizeof(struct shm_caption));
+        rec->len = ring->hdr->size - pos;
+        rec->flags = SHM_CAPTION_PADDING;
+
+        head += rec->len;
+        __atomic_store_n(&(ring->hdr->head), head, __ATOMIC_RELEASE);
+        pos = 0;
+    }
+
+    if (shm_ring_reserve(ring, head, len)) {
+        return NULL;
+    }
+
+    rec = (struct shm_caption*) (ring->data + pos);
+    memcpy(rec, caption, sizeof(struct shm_caption));
+    rec->len = len;
+    rec->flags = 0;
+
+    ring->pending = head + len;
+
+    return ring->data + pos + sizeof(struct shm_caption);
+}
+
+
+void shm_ring_commit(struct shm_ring* ring) {
+    __atomic_store_n(&(ring->hdr->head), ring->pending, __ATOMIC_RELEASE);
+}
+
+
+int shm_ring_publish(struct shm_ring* ring, const struct shm_caption* caption,
+                     const unsigned char* img) {
+    unsigned char* dest;
+
+    if ((dest = shm_ring_begin(ring, caption)) == NULL) {
+        return -1;
+    }
+
+    memcpy(dest, img, (size_t) caption->width * caption->height);
+    shm_ring_commit(ring);
+
+    return 0;
+}
+
+
+void shm_ring_finish(struct shm_ring* ring) {
+    __atomic_store_n(&(ring->hdr->closed), 1, __ATOMIC_RELEASE);
+}
+
+
+int shm_ring_open(struct shm_ring* ring, const char* name) {
+    struct stat st;
+
+    if (ring == NULL || name == NULL) {
+        return -1;
+    }
+
+    ring->hdr = NULL;
+    ring->abandoned = 0;
+    if ((ring->fd = shm_open(name, O_RDWR, 0)) < 0) {
+        if (errno != ENOENT) {
+            perror("shm_ring_open(): shm_open()");
+        }
+        return -1;
+    }
+    if (fstat(ring->fd, &st) || st.st_size < (off_t) sizeof(struct shm_ring_header)) {
+        fprintf(stderr, "Shared memory object is too small.\n");
+        close(ring->fd);
+        return -1;
+    }
+    if (shm_ring_map(ring, st.st_size)) {
+        close(ring->fd);
+        return -1;
+    }
+
+    if (__atomic_load_n(&(ring->hdr->magic), __ATOMIC_ACQUIRE) != SHM_RING_MAGIC ||
+        ring->hdr->version != SHM_RING_VERSION ||
+        sizeof(struct shm_ring_header) + ring->hdr->size > ring->map_len) {
+        fprintf(stderr, "Not a sup2pgm ring buffer.\n");
+        shm_ring_close(ring);
+        return -1;
+    }
+
+    __atomic_store_n(&(ring->hdr->consumer), (uint32_t) getpid(), __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+
+/**
+ * Waits for the next caption; returns NULL once the producer is done and
+ * everything has been consumed.
+ */
+const struct shm_caption* shm_ring_peek(struct shm_ring* ring) {
+    long backoff = SHM_BACKOFF_MIN;
+    const struct shm_caption* rec;
+    uint64_t head, tail = ring->hdr->tail;
+    uint32_t closed;
+
+    while (1) {
+        /* Check closed first, so a record published right before closing isn't lost. */
+        closed = __atomic_load_n(&(ring->hdr->closed), __ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&(ring->hdr->head), __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (closed) {
+                return NULL;
+            }
+            shm_backoff(&backoff);
+            continue;
+        }
+
+        rec = (const struct shm_caption*) (ring->data + tail % ring->hdr->size);
+        if (rec->flags & SHM_CAPTION_PADDING) {
+            tail += rec->len;
+            __atomic_store_n(&(ring->hdr->tail), tail, __ATOMIC_RELEASE);
+            continue;
+        }
+
+        return rec;
+    }
+}
+
+
+void shm_ring_release(struct shm_ring* ring, const struct shm_caption* caption) {
+    __atomic_store_n(&(ring->hdr->tail), ring->hdr->tail + caption->len, __ATOMIC_RELEASE);
+}
+
+
+void shm_ring_close(struct shm_ring* ring) {
+    uint32_t pid = getpid();
+
+    if (ring->hdr != NULL) {
+        /* Detach if it's the consumer, a later one may take over. */
+        __atomic_compare_exchange_n(&(ring->hdr->consumer), &pid, 0, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        munmap(ring->hdr, ring->map_len);
+        ring->hdr = NULL;
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef SUP2PGM_SHM_H
+#define SUP2PGM_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHM_RING_MAGIC 0x53555052  /* "SUPR" */
+#define SHM_RING_VERSION 2
+#define SHM_RING_DEFAULT_SIZE (64 * 1024 * 1024)
+
+/* How long a full ring waits for a consumer to attach before giving up. */
+#define SHM_ATTACH_TIMEOUT_MS 30000
+
+#define SHM_CAPTION_PADDING 0x01  /* Skip to the start of the ring */
+
+
+/**
+ * Ring buffer control block at the start of the shared memory object.
+ *
+ * Single producer, single consumer: the producer only ever writes head,
+ * the consumer only ever writes tail.  Both are running byte counters,
+ * the position in the data area is the counter modulo size.  The consumer
+ * puts its pid in consumer while attached, so that a producer waiting for
+ * room can tell it's gone.
+ */
+struct shm_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;       /* Data area length, multiple of the record alignment */
+    uint64_t head;       /* Bytes published by the producer */
+    uint64_t tail;       /* Bytes released by the consumer */
+    uint32_t closed;     /* Producer is done, nothing more will be published */
+    uint32_t consumer;   /* Consumer's pid, 0 while none is attached */
+};
+
+
+/**
+ * Caption record: this header followed by width * height gray pixels,
+ * padded to the size of the header.
+ */
+struct shm_caption {
+    uint32_t len;           /* Record length, header and padding included */
+    uint32_t flags;
+    uint32_t subtitle_num;  /* 1-based, same as in the .srtx */
+    uint32_t start_ms;
+    uint32_t end_ms;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+};
+
+
+struct shm_ring {
+    int fd;
+    size_t map_len;
+    struct shm_ring_header* hdr;
+    unsigned char* data;
+    uint64_t pending;  /* Head once the record being written is committed */
+    uint8_t abandoned; /* No consumer to make room, nothing more can be published */
+};
+
+
+int shm_ring_create(struct shm_ring* ring, const char* name, size_t size);
+unsigned char* shm_ring_begin(struct shm_ring* ring, const struct shm_caption* caption);
+void shm_ring_commit(struct shm_ring* ring);
+int shm_ring_publish(struct shm_ring* ring, const struct shm_caption* caption,
+                     const unsigned char* img);
+void shm_ring_finish(struct shm_ring* ring);
+
+int shm_ring_open(struct shm_ring* ring, const char* name);
+const struct shm_caption* shm_ring_peek(struct shm_ring* ring);
+void shm_ring_release(struct shm_ring* ring, const struct shm_caption* caption);
+
+void shm_ring_close(struct shm_ring* ring);
+
+#endif  /* SUP2PGM_SHM_H */
@@ -0,0 +1,136 @@
+/**
+ * SUP2PGM-SHMCAT
+ * Reference consumer for the sup2pgm --shm ring buffer: prints the
+ * timecodes of every caption and optionally saves it as a PGM image.
+ *
+ * Copyright (c) 2013, Sergey Kolchin <ksa242@gmail.com>
+ * All rights reserved.
+ * Released under 3-clause BSD License.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "pgm.h"
+#include "shm.h"
+#include "srt.h"
+
+#define SHMCAT_PROGRAM_NAME "sup2pgm-shmcat"
+
+/* How long to wait for the producer to create the ring, in seconds. */
+#define SHMCAT_OPEN_TIMEOUT 10
+
+
+void print_usage_help(const char* bin) {
+    printf("%s [options] <shm_name>\n\n", bin);
+
+    printf("Options:\n");
+    printf("  -o <base_name>  Save captions as PGM images with base_name.\n");
+    printf("  -k              Keep the shared memory object when done.\n");
+}
+
+
+int main(int argc, char* argv[]) {
+    size_t i;
+
+    char* shm_name = NULL;
+    uint8_t keep = 0;
+    struct shm_ring ring;
+    const struct shm_caption* caption;
+    struct timespec ts;
+
+    char* pgm_base_filename = NULL;
+    char* pgm_filename = NULL;
+    FILE* pgm_file;
+
+    char timecode[SRT_TIMECODE_LEN + 1];
+    size_t caption_num = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "-?")) {
+            print_usage_help(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (!strcmp(argv[i], "-k")) {
+            keep = 1;
+        } else if (!strcmp(argv[i], "-o")) {
+            i++;
+            if (i == argc || strlen(argv[i]) == 0) {
+                fprintf(stderr, "Please specify the base name for PGM images.\n");
+                return EXIT_FAILURE;
+            } else {
+                pgm_base_filename = argv[i];
+            }
+        } else {
+            shm_name = argv[i];
+        }
+    }
+
+    if (shm_name == NULL) {
+        print_usage_help(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (pgm_base_filename != NULL) {
+        pgm_filename = calloc(strlen(pgm_base_filename) + 10, sizeof(char));
+        if (pgm_filename == NULL) {
+            perror("main(): calloc(PGM_FILENAME)");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* The producer may not have started yet. */
+    ts.tv_sec = 0;
+    ts.tv_nsec = 100000000;
+    for (i = 0; shm_ring_open(&ring, shm_name); i++) {
+        if (i == SHMCAT_OPEN_TIMEOUT * 10) {
+            fprintf(stderr, "Failed opening ring buffer %s.\n", shm_name);
+            free(pgm_filename);
+            return EXIT_FAILURE;
+        }
+        nanosleep(&ts, NULL);
+    }
+
+    while ((caption = shm_ring_peek(&ring)) != NULL) {
+        printf("%u\n", caption->subtitle_num);
+        srt_render_time(caption->start_ms, timecode);
+        printf("%s --> ", timecode);
+        srt_render_time(caption->end_ms, timecode);
+        printf("%s\n", timecode);
+
+        if (pgm_filename != NULL) {
+            sprintf(pgm_filename, "%s%05u.pgm", pgm_base_filename, caption->subtitle_num - 1);
+            if ((pgm_file = fopen(pgm_filename, "wb")) == NULL) {
+                perror("main(): fopen(PGM)");
+            } else {
+                pgm_write(pgm_file, (const unsigned char*) (caption + 1),
+                          caption->width, caption->height);
+                fclose(pgm_file);
+                printf("%s\n", pgm_filename);
+            }
+        } else {
+            printf("%ux%u\n", caption->width, caption->height);
+        }
+        printf("\n");
+
+        shm_ring_release(&ring, caption);
+        caption_num++;
+    }
+
+    fprintf(stderr, "%lu captions received.\n", caption_num);
+
+    shm_ring_close(&ring);
+    if (!keep) {
+        shm_unlink(shm_name);
+    }
+
+    free(pgm_filename);
+
+    return EXIT_SUCCESS;
+}
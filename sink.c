@@ -0,0 +1,357 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "canvas.h"
+#include "pgm.h"
+#include "sink.h"
+#include "sup.h"
+#include "y4m.h"
+
+
+int sink_find_object(struct sink_object* obj, uint16_t obj_id,
+                     const struct sup_segment_pcs* pcs,
+                     const struct sup_segment_wds* wds) {
+    const struct sup_object* pcs_obj;
+    size_t i;
+
+    if ((pcs_obj = sup_find_object(pcs, obj_id)) == NULL) {
+        return -1;
+    }
+
+    memset(obj, 0x00, sizeof(struct sink_object));
+    obj->obj_id = obj_id;
+    obj->obj_flag = pcs_obj->obj_flag;
+    obj->x = pcs_obj->obj_pos_x;
+    obj->y = pcs_obj->obj_pos_y;
+
+    for (i = 0; i < wds->num_of_windows; i++) {
+        if (wds->windows[i].win_id == pcs_obj->win_id) {
+            obj->window_x = wds->windows[i].x;
+            obj->window_y = wds->windows[i].y;
+            obj->window_width = wds->windows[i].width;
+            obj->window_height = wds->windows[i].height;
+            break;
+        }
+    }
+
+    if (obj->window_width == 0 ||
+        obj->window_height == 0 ||
+        obj->x < obj->window_x ||
+        obj->y < obj->window_y) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Walks the RLE data looking for pixels that map to a non-zero value of
+ * lut, without decoding it.  With rows, marks the ones they're on, rows[0]
+ * being the object's first, and goes on to the end; without, stops at the
+ * first one.  Returns whether there are any.
+ */
+static int sink_rle_scan(const unsigned char* src, size_t src_len, const uint8_t* lut,
+                         uint8_t* rows, size_t rows_len) {
+    size_t src_idx = 0, y = 0, n;
+    unsigned char b;
+    int visible = 0;
+
+    while (src_idx < src_len) {
+        b = src[src_idx++];
+        if (b != 0x00) {
+            if (lut[b] != 0x00) {
+                if (rows == NULL) {
+                    return 1;
+                }
+                visible = 1;
+                if (y < rows_len) {
+                    rows[y] = 1;
+                }
+            }
+            continue;
+        }
+        if (src_idx >= src_len) {
+            break;
+        }
+
+        b = src[src_idx++];
+        switch (b & 0xc0) {
+        case 0x00:
+            /* 00 00 new line, 00 xx zeroes. */
+            if (b == 0x00) {
+                y++;
+            }
+            continue;
+
+        case 0x40:
+            /* 00 4x xx zeroes. */
+            src_idx++;
+            continue;
+
+        case 0x80:
+            n = b & 0x3f;
+            break;
+
+        default:
+            if (src_idx >= src_len) {
+                return 0;
+            }
+            n = ((b & 0x3f) << 8) + src[src_idx++];
+            break;
+        }
+
+        if (src_idx >= src_len) {
+            break;
+        }
+        b = src[src_idx++];
+        if (n > 0 && lut[b] != 0x00) {
+            if (rows == NULL) {
+                return 1;
+            }
+            visible = 1;
+            if (y < rows_len) {
+                rows[y] = 1;
+            }
+        }
+    }
+
+    return visible;
+}
+
+
+/**
+ * Tells whether anything of the object would show.  Placement isn't
+ * considered: an object may still be clipped away entirely.
+ */
+int sink_rle_visible(const unsigned char* src, size_t src_len, const uint8_t* lut) {
+    return sink_rle_scan(src, src_len, lut, NULL, 0);
+}
+
+
+/**
+ * Marks the rows of the object with anything that would show.
+ */
+int sink_rle_rows(const unsigned char* src, size_t src_len, const uint8_t* lut,
+                  uint8_t* rows, size_t rows_len) {
+    return sink_rle_scan(src, src_len, lut, rows, rows_len);
+}
+
+
+/* Clears the part of the window that fits into the image. */
+static void sink_clear_window(unsigned char* img, size_t width, size_t height,
+                              const struct sink_object* obj) {
+    size_t window_width = obj->window_width,
+           window_height = obj->window_height;
+
+    if (obj->window_x >= width || obj->window_y >= height) {
+        return;
+    }
+    if (window_width > width - obj->window_x) {
+        window_width = width - obj->window_x;
+    }
+    if (window_height > height - obj->window_y) {
+        window_height = height - obj->window_y;
+    }
+
+    pgm_clear_region(img, width, height,
+                     window_width, window_height,
+                     obj->window_x, obj->window_y);
+}
+
+
+static int sink_no_end_caption(struct sink* sink) {
+    return 0;
+}
+
+
+/**
+ * Gray canvas.
+ */
+static int sink_gray_begin_caption(struct sink* base,
+                                   const struct sup_segment_pcs* pcs,
+                                   const struct sup_segment_pds* pds) {
+    struct sink_gray* sink = (struct sink_gray*) base;
+
+    return sup_palette_lut(pds, SUP_CHANNEL_GRAY, sink->lut);
+}
+
+
+static inline void sink_gray_begin_object(struct sink_gray* sink, const struct sink_object* obj) {
+    canvas_clear_region(sink->canvas,
+                        obj->window_width, obj->window_height,
+                        obj->window_x, obj->window_y);
+}
+
+
+static inline void sink_gray_emit_run(struct sink_gray* sink, size_t pos, size_t y,
+                                      uint8_t idx, size_t n) {
+    canvas_fill(sink->canvas, pos - y * sink->base.width, y, sink->lut[idx], n);
+}
+
+
+static inline void sink_gray_emit_literal(struct sink_gray* sink, size_t pos, size_t y,
+                                          uint8_t idx) {
+    canvas_fill(sink->canvas, pos - y * sink->base.width, y, sink->lut[idx], 1);
+}
+
+
+SINK_DEFINE_RENDER_OBJECT(sink_gray_render_object, struct sink_gray,
+                          sink_gray_begin_object,
+                          sink_gray_emit_run,
+                          sink_gray_emit_literal)
+
+
+static const struct sink_ops sink_gray_ops = {
+    "gray",
+    sink_gray_begin_caption,
+    sink_gray_render_object,
+    sink_no_end_caption
+};
+
+
+int sink_gray_init(struct sink_gray* sink, struct canvas* canvas) {
+    if (sink == NULL || canvas == NULL) {
+        return -1;
+    }
+
+    sink->base.ops = &sink_gray_ops;
+    sink->base.width = canvas->width;
+    sink->base.height = canvas->height;
+    sink->canvas = canvas;
+    memset(sink->lut, 0x00, sizeof(sink->lut));
+
+    return 0;
+}
+
+
+/**
+ * Palette indices.
+ */
+static int sink_index_begin_caption(struct sink* base,
+                                    const struct sup_segment_pcs* pcs,
+                                    const struct sup_segment_pds* pds) {
+    return 0;
+}
+
+
+static inline void sink_index_begin_object(struct sink_index* sink, const struct sink_object* obj) {
+    memset(sink->img, 0x00, sink->base.width * sink->base.height);
+}
+
+
+static inline void sink_index_emit_run(struct sink_index* sink, size_t pos, size_t y,
+                                       uint8_t idx, size_t n) {
+    memset(sink->img + pos, idx, n);
+}
+
+
+static inline void sink_index_emit_literal(struct sink_index* sink, size_t pos, size_t y,
+                                           uint8_t idx) {
+    sink->img[pos] = idx;
+}
+
+
+SINK_DEFINE_RENDER_OBJECT(sink_index_render_object, struct sink_index,
+                          sink_index_begin_object,
+                          sink_index_emit_run,
+                          sink_index_emit_literal)
+
+
+static const struct sink_ops sink_index_ops = {
+    "index",
+    sink_index_begin_caption,
+    sink_index_render_object,
+    sink_no_end_caption
+};
+
+
+int sink_index_init(struct sink_index* sink, unsigned char* img, size_t width, size_t height) {
+    if (sink == NULL) {
+        return -1;
+    }
+
+    sink->base.ops = &sink_index_ops;
+    sink->base.width = width;
+    sink->base.height = height;
+    sink->img = img;
+
+    return 0;
+}
+
+
+/**
+ * Y4M frame planes, written in a single pass over the RLE data.
+ */
+static int sink_y4m_begin_caption(struct sink* base,
+                                  const struct sup_segment_pcs* pcs,
+                                  const struct sup_segment_pds* pds) {
+    struct sink_y4m* sink = (struct sink_y4m*) base;
+
+    if (sup_palette_lut(pds, SUP_CHANNEL_Y, sink->luts[Y4M_PLANE_Y]) ||
+        sup_palette_lut(pds, SUP_CHANNEL_CB, sink->luts[Y4M_PLANE_CB]) ||
+        sup_palette_lut(pds, SUP_CHANNEL_CR, sink->luts[Y4M_PLANE_CR]) ||
+        sup_palette_lut(pds, SUP_CHANNEL_A, sink->luts[Y4M_PLANE_A])) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static inline void sink_y4m_begin_object(struct sink_y4m* sink, const struct sink_object* obj) {
+    size_t i;
+
+    for (i = 0; i < Y4M_PLANES; i++) {
+        sink_clear_window(sink->y4m->planes[i], sink->base.width, sink->base.height, obj);
+    }
+}
+
+
+static inline void sink_y4m_emit_run(struct sink_y4m* sink, size_t pos, size_t y,
+                                     uint8_t idx, size_t n) {
+    memset(sink->y4m->planes[Y4M_PLANE_Y] + pos, sink->luts[Y4M_PLANE_Y][idx], n);
+    memset(sink->y4m->planes[Y4M_PLANE_CB] + pos, sink->luts[Y4M_PLANE_CB][idx], n);
+    memset(sink->y4m->planes[Y4M_PLANE_CR] + pos, sink->luts[Y4M_PLANE_CR][idx], n);
+    memset(sink->y4m->planes[Y4M_PLANE_A] + pos, sink->luts[Y4M_PLANE_A][idx], n);
+}
+
+
+static inline void sink_y4m_emit_literal(struct sink_y4m* sink, size_t pos, size_t y,
+                                         uint8_t idx) {
+    sink->y4m->planes[Y4M_PLANE_Y][pos] = sink->luts[Y4M_PLANE_Y][idx];
+    sink->y4m->planes[Y4M_PLANE_CB][pos] = sink->luts[Y4M_PLANE_CB][idx];
+    sink->y4m->planes[Y4M_PLANE_CR][pos] = sink->luts[Y4M_PLANE_CR][idx];
+    sink->y4m->planes[Y4M_PLANE_A][pos] = sink->luts[Y4M_PLANE_A][idx];
+}
+
+
+SINK_DEFINE_RENDER_OBJECT(sink_y4m_render_object, struct sink_y4m,
+                          sink_y4m_begin_object,
+                          sink_y4m_emit_run,
+                          sink_y4m_emit_literal)
+
+
+static const struct sink_ops sink_y4m_ops = {
+    "y4m",
+    sink_y4m_begin_caption,
+    sink_y4m_render_object,
+    sink_no_end_caption
+};
+
+
+int sink_y4m_init(struct sink_y4m* sink, struct y4m_stream* y4m) {
+    if (sink == NULL || y4m == NULL) {
+        return -1;
+    }
+
+    sink->base.ops = &sink_y4m_ops;
+    sink->base.width = y4m->width;
+    sink->base.height = y4m->height;
+    sink->y4m = y4m;
+    memset(sink->luts, 0x00, sizeof(sink->luts));
+
+    return 0;
+}
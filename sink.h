@@ -0,0 +1,180 @@
+#ifndef SUP2PGM_SINK_H
+#define SUP2PGM_SINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "canvas.h"
+#include "sup.h"
+#include "y4m.h"
+
+
+/**
+ * Where and how to draw a composition object, resolved from PCS and WDS.
+ */
+struct sink_object {
+    uint16_t obj_id;
+    uint8_t obj_flag;
+    size_t x;
+    size_t y;
+    size_t window_x;
+    size_t window_y;
+    size_t window_width;
+    size_t window_height;
+};
+
+
+struct sink;
+
+/**
+ * Output sink: a caption is begun with its composition and palette, then
+ * each object's RLE data is fed to render_object(), then it's ended.
+ *
+ * render_object() is normally generated with SINK_DEFINE_RENDER_OBJECT(),
+ * so that every sink gets an RLE walker of its own with the per-run and
+ * per-pixel work inlined.
+ */
+struct sink_ops {
+    const char* name;
+    int (*begin_caption)(struct sink* sink,
+                         const struct sup_segment_pcs* pcs,
+                         const struct sup_segment_pds* pds);
+    int (*render_object)(struct sink* sink, const struct sink_object* obj,
+                         const unsigned char* src, size_t src_len);
+    int (*end_caption)(struct sink* sink);
+};
+
+
+struct sink {
+    const struct sink_ops* ops;
+    size_t width;
+    size_t height;
+};
+
+
+/**
+ * 8-bit gray canvas (Y premultiplied by alpha), as saved to PGM images.
+ */
+struct sink_gray {
+    struct sink base;
+    struct canvas* canvas;
+    uint8_t lut[0x100];
+};
+
+
+/**
+ * Raw palette indices of a single object, drawn at its origin.
+ */
+struct sink_index {
+    struct sink base;
+    unsigned char* img;
+};
+
+
+/**
+ * Y, Cb, Cr and alpha planes of a Y4M frame.
+ */
+struct sink_y4m {
+    struct sink base;
+    struct y4m_stream* y4m;
+    uint8_t luts[Y4M_PLANES][0x100];
+};
+
+
+/**
+ * Defines render_object() for a sink type.  The sink supplies:
+ *   BEGIN_OBJECT(sink, obj)              prepare the object's window;
+ *   EMIT_RUN(sink, pos, y, idx, count)   draw count pixels of color idx at pos;
+ *   EMIT_LITERAL(sink, pos, y, idx)      draw one pixel of color idx at pos.
+ * Positions are pixel offsets in a sink->base.width wide image, runs never
+ * cross its end.  y is the row the current RLE line started on; a malformed
+ * line may run past it, in which case pos is further down.  Color 0 runs
+ * are transparent and only move the position.
+ */
+#define SINK_DEFINE_RENDER_OBJECT(name, type, BEGIN_OBJECT, EMIT_RUN, EMIT_LITERAL)   \
+static int name(struct sink* base, const struct sink_object* obj,                     \
+                const unsigned char* src, size_t src_len) {                           \
+    type* sink = (type*) base;                                                        \
+    size_t dest_len = base->width * base->height,                                     \
+           y = obj->y,                                                                \
+           dest_idx = y * base->width + obj->x,                                       \
+           src_idx = 0,                                                               \
+           n;                                                                         \
+    unsigned char b;                                                                  \
+                                                                                      \
+    BEGIN_OBJECT(sink, obj);                                                          \
+                                                                                      \
+    while (src_idx < src_len && dest_idx < dest_len) {                                \
+        b = src[src_idx++];                                                           \
+        if (b != 0x00) {                                                              \
+            EMIT_LITERAL(sink, dest_idx, y, b);                                       \
+            dest_idx++;                                                               \
+            continue;                                                                 \
+        }                                                                             \
+        if (src_idx >= src_len) {                                                     \
+            break;                                                                    \
+        }                                                                             \
+                                                                                      \
+        b = src[src_idx++];                                                           \
+        if (b == 0x00) {                                                              \
+            /* 00 00 eq. new line. */                                                 \
+            y++;                                                                      \
+            dest_idx = y * base->width + obj->x;                                      \
+            continue;                                                                 \
+        }                                                                             \
+                                                                                      \
+        if ((b & 0x40) && src_idx >= src_len) {                                       \
+            break;                                                                    \
+        }                                                                             \
+        switch (b & 0xc0) {                                                           \
+        case 0x00:                                                                    \
+            /* 00 xx -> xx times 0. */                                                \
+            dest_idx += b;                                                            \
+            continue;                                                                 \
+                                                                                      \
+        case 0x40:                                                                    \
+            /* 00 4x xx -> xxx zeroes. */                                             \
+            dest_idx += ((b & 0x3f) << 8) + src[src_idx++];                           \
+            continue;                                                                 \
+                                                                                      \
+        case 0x80:                                                                    \
+            /* 00 8x yy -> x times value y. */                                        \
+            n = b & 0x3f;                                                             \
+            break;                                                                    \
+                                                                                      \
+        default:                                                                      \
+            /* 00 cx yy zz -> xyy times value z. */                                   \
+            n = ((b & 0x3f) << 8) + src[src_idx++];                                   \
+            break;                                                                    \
+        }                                                                             \
+                                                                                      \
+        if (src_idx >= src_len) {                                                     \
+            break;                                                                    \
+        }                                                                             \
+        b = src[src_idx++];                                                           \
+        if (dest_idx < dest_len) {                                                    \
+            if (n > dest_len - dest_idx) {                                            \
+                n = dest_len - dest_idx;                                              \
+            }                                                                         \
+            EMIT_RUN(sink, dest_idx, y, b, n);                                        \
+            dest_idx += n;                                                            \
+        }                                                                             \
+    }                                                                                 \
+                                                                                      \
+    return 0;                                                                         \
+}
+
+
+int sink_find_object(struct sink_object* obj, uint16_t obj_id,
+                     const struct sup_segment_pcs* pcs,
+                     const struct sup_segment_wds* wds);
+
+int sink_rle_visible(const unsigned char* src, size_t src_len, const uint8_t* lut);
+int sink_rle_rows(const unsigned char* src, size_t src_len, const uint8_t* lut,
+                  uint8_t* rows, size_t rows_len);
+
+int sink_gray_init(struct sink_gray* sink, struct canvas* canvas);
+int sink_index_init(struct sink_index* sink, unsigned char* img, size_t width, size_t height);
+int sink_y4m_init(struct sink_y4m* sink, struct y4m_stream* y4m);
+
+#endif  /* SUP2PGM_SINK_H */
@@ -6,6 +6,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 
+#include "mem.h"
 #include "sup.h"
 
 
@@ -35,6 +36,44 @@ float sup_frame_rate_by_id(uint8_t frame_rate_id) {
 }
 
 
+int sup_frame_rate_ratio(uint8_t frame_rate_id, unsigned int* num, unsigned int* den) {
+    switch (frame_rate_id) {
+    case SUP_FPS_23_976:
+        *num = 24000;
+        *den = 1001;
+        return 0;
+
+    case SUP_FPS_FILM:
+        *num = 24;
+        *den = 1;
+        return 0;
+
+    case SUP_FPS_PAL:
+        *num = 25;
+        *den = 1;
+        return 0;
+
+    case SUP_FPS_NTSC:
+        *num = 30000;
+        *den = 1001;
+        return 0;
+
+    case SUP_FPS_PAL_I:
+        *num = 50;
+        *den = 1;
+        return 0;
+
+    case SUP_FPS_NTSC_I:
+        *num = 60000;
+        *den = 1001;
+        return 0;
+
+    default:
+        return -1;
+    }
+}
+
+
 unsigned long sup_pts_to_ms(uint32_t pts) {
     return pts / SUP_PTS_FREQ;
 }
@@ -54,7 +93,7 @@ int sup_init_packet(struct sup_packet* packet) {
     packet->segment_len = 0x0000;
 
     if (packet->segment == NULL) {
-        packet->segment = calloc(SUP_PACKET_MAX_SEGMENT_LEN, sizeof(char));
+        packet->segment = mem_calloc(SUP_PACKET_MAX_SEGMENT_LEN, sizeof(char));
         if (packet->segment == NULL) {
             perror("sup_init_packet(): calloc()");
             return -1;
@@ -131,6 +170,84 @@ int sup_read_packet(FILE* fd, struct sup_packet* packet) {
 }
 
 
+/**
+ * Parses the fixed-size packet header; the segment is left alone.
+ */
+int sup_parse_packet_header(const unsigned char* buf, struct sup_packet* packet) {
+    size_t offset = 0;
+
+    memcpy(&(packet->marker), buf + offset, 2);
+    offset += 2;
+    packet->marker = ntohs(packet->marker);
+    if (packet->marker != SUP_PACKET_MARKER) {
+        fprintf(stderr, "Invalid packet marker.\n");
+        return -1;
+    }
+
+    memcpy(&(packet->pts), buf + offset, 4);
+    offset += 4;
+    memcpy(&(packet->dts), buf + offset, 4);
+    offset += 4;
+    memcpy(&(packet->segment_type), buf + offset, 1);
+    offset++;
+    memcpy(&(packet->segment_len), buf + offset, 2);
+    offset += 2;
+
+    packet->pts = ntohl(packet->pts);
+    packet->dts = ntohl(packet->dts);
+    packet->segment_len = ntohs(packet->segment_len);
+
+    return 0;
+}
+
+
+static size_t sup_put_u8(unsigned char* buf, uint8_t value) {
+    *buf = value;
+    return 1;
+}
+
+
+static size_t sup_put_u16(unsigned char* buf, uint16_t value) {
+    value = htons(value);
+    memcpy(buf, &value, 2);
+    return 2;
+}
+
+
+static size_t sup_put_u32(unsigned char* buf, uint32_t value) {
+    value = htonl(value);
+    memcpy(buf, &value, 4);
+    return 4;
+}
+
+
+void sup_serialize_packet_header(const struct sup_packet* packet, unsigned char* buf) {
+    size_t offset = 0;
+
+    offset += sup_put_u16(buf + offset, SUP_PACKET_MARKER);
+    offset += sup_put_u32(buf + offset, packet->pts);
+    offset += sup_put_u32(buf + offset, packet->dts);
+    offset += sup_put_u8(buf + offset, packet->segment_type);
+    sup_put_u16(buf + offset, packet->segment_len);
+}
+
+
+int sup_write_packet(FILE* fd, const struct sup_packet* packet) {
+    unsigned char header[SUP_PACKET_HEADER_LEN];
+
+    sup_serialize_packet_header(packet, header);
+
+    if (fwrite(header, SUP_PACKET_HEADER_LEN, 1, fd) != 1 ||
+        (packet->segment_len > 0 &&
+         fwrite(packet->segment, packet->segment_len, 1, fd) != 1)) {
+        perror("sup_write_packet(): fwrite()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 int sup_init_segment_pcs(struct sup_segment_pcs* pcs) {
     if (pcs == NULL) {
         return -1;
@@ -148,7 +265,7 @@ int sup_init_segment_pcs(struct sup_segment_pcs* pcs) {
 
     pcs->num_of_objects = 0x00;
     if (pcs->objects == NULL) {
-        pcs->objects = calloc(0xff, sizeof(struct sup_object));
+        pcs->objects = mem_calloc(0xff, sizeof(struct sup_object));
         if (pcs->objects == NULL) {
             perror("sup_init_segment_pcs(): calloc()");
             return -1;
@@ -227,6 +344,47 @@ int sup_parse_segment_pcs(const struct sup_packet* packet, struct sup_segment_pc
 }
 
 
+const struct sup_object* sup_find_object(const struct sup_segment_pcs* pcs, uint16_t obj_id) {
+    size_t i;
+
+    if (pcs == NULL || pcs->objects == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < pcs->num_of_objects; i++) {
+        if (pcs->objects[i].obj_id == obj_id) {
+            return &(pcs->objects[i]);
+        }
+    }
+
+    return NULL;
+}
+
+
+size_t sup_serialize_segment_pcs(const struct sup_segment_pcs* pcs, unsigned char* buf) {
+    size_t i, offset = 0;
+
+    offset += sup_put_u16(buf + offset, pcs->video_width);
+    offset += sup_put_u16(buf + offset, pcs->video_height);
+    offset += sup_put_u8(buf + offset, pcs->frame_rate);
+    offset += sup_put_u16(buf + offset, pcs->comp_id);
+    offset += sup_put_u8(buf + offset, pcs->comp_state);
+    offset += sup_put_u8(buf + offset, pcs->palette_flag);
+    offset += sup_put_u8(buf + offset, pcs->palette_id);
+    offset += sup_put_u8(buf + offset, pcs->num_of_objects);
+
+    for (i = 0; i < pcs->num_of_objects; i++) {
+        offset += sup_put_u16(buf + offset, pcs->objects[i].obj_id);
+        offset += sup_put_u8(buf + offset, pcs->objects[i].win_id);
+        offset += sup_put_u8(buf + offset, pcs->objects[i].obj_flag & ~SUP_PCS_OBJ_CROPPED);
+        offset += sup_put_u16(buf + offset, pcs->objects[i].obj_pos_x);
+        offset += sup_put_u16(buf + offset, pcs->objects[i].obj_pos_y);
+    }
+
+    return offset;
+}
+
+
 int sup_init_segment_pds(struct sup_segment_pds* pds) {
     if (pds == NULL) {
         return -1;
@@ -235,7 +393,7 @@ int sup_init_segment_pds(struct sup_segment_pds* pds) {
     pds->palette_id = 0x0000;
     pds->num_of_colors = 0x00;
     if (pds->colors == NULL) {
-        pds->colors = calloc(0xff, sizeof(struct sup_color));
+        pds->colors = mem_calloc(0xff, sizeof(struct sup_color));
         if (pds->colors == NULL) {
             perror("sup_init_segment_pds(): calloc()");
             return -1;
@@ -286,6 +444,71 @@ int sup_parse_segment_pds(const struct sup_packet* packet, struct sup_segment_pd
 }
 
 
+/**
+ * Fills a 256-entry lookup table with one channel of the palette, indexed
+ * by the entries' index bytes, the way the RLE data references colors,
+ * whatever order they're listed in.  Missing entries are 0.
+ */
+int sup_palette_lut(const struct sup_segment_pds* pds, int channel, uint8_t* lut) {
+    const struct sup_color* color;
+    size_t i;
+
+    if (pds == NULL || lut == NULL) {
+        return -1;
+    }
+
+    memset(lut, 0x00, 0x100);
+
+    for (i = 0; i < pds->num_of_colors; i++) {
+        color = &(pds->colors[i]);
+        switch (channel) {
+        case SUP_CHANNEL_GRAY:
+            lut[color->idx] = color->gray;
+            break;
+
+        case SUP_CHANNEL_Y:
+            lut[color->idx] = color->y;
+            break;
+
+        case SUP_CHANNEL_CR:
+            lut[color->idx] = color->cr;
+            break;
+
+        case SUP_CHANNEL_CB:
+            lut[color->idx] = color->cb;
+            break;
+
+        case SUP_CHANNEL_A:
+            lut[color->idx] = color->a;
+            break;
+
+        default:
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+size_t sup_serialize_segment_pds(const struct sup_segment_pds* pds, unsigned char* buf) {
+    size_t i, offset = 0;
+
+    /* Palette ID and version. */
+    offset += sup_put_u16(buf + offset, pds->palette_id);
+
+    for (i = 0; i < pds->num_of_colors; i++) {
+        offset += sup_put_u8(buf + offset, pds->colors[i].idx);
+        offset += sup_put_u8(buf + offset, pds->colors[i].y);
+        offset += sup_put_u8(buf + offset, pds->colors[i].cr);
+        offset += sup_put_u8(buf + offset, pds->colors[i].cb);
+        offset += sup_put_u8(buf + offset, pds->colors[i].a);
+    }
+
+    return offset;
+}
+
+
 int sup_init_segment_wds(struct sup_segment_wds* wds) {
     if (wds == NULL) {
         return -1;
@@ -293,7 +516,7 @@ int sup_init_segment_wds(struct sup_segment_wds* wds) {
 
     wds->num_of_windows = 0x00;
     if (wds->windows == NULL) {
-        wds->windows = calloc(0xff, sizeof(struct sup_window));
+        wds->windows = mem_calloc(0xff, sizeof(struct sup_window));
         if (wds->windows == NULL) {
             perror("sup_init_segment_wds(): calloc()");
             return -1;
@@ -350,6 +573,23 @@ int sup_parse_segment_wds(const struct sup_packet* packet, struct sup_segment_wd
 }
 
 
+size_t sup_serialize_segment_wds(const struct sup_segment_wds* wds, unsigned char* buf) {
+    size_t i, offset = 0;
+
+    offset += sup_put_u8(buf + offset, wds->num_of_windows);
+
+    for (i = 0; i < wds->num_of_windows; i++) {
+        offset += sup_put_u8(buf + offset, wds->windows[i].win_id);
+        offset += sup_put_u16(buf + offset, wds->windows[i].x);
+        offset += sup_put_u16(buf + offset, wds->windows[i].y);
+        offset += sup_put_u16(buf + offset, wds->windows[i].width);
+        offset += sup_put_u16(buf + offset, wds->windows[i].height);
+    }
+
+    return offset;
+}
+
+
 int sup_init_segment_ods(struct sup_segment_ods* ods) {
     if (ods == NULL) {
         return -1;
@@ -429,3 +669,28 @@ int sup_parse_segment_ods(const struct sup_packet* packet, struct sup_segment_od
 
     return 0;
 }
+
+
+/**
+ * Serializes one ODS fragment: object size and data length are only
+ * included in the first one.
+ */
+size_t sup_serialize_segment_ods(const struct sup_segment_ods* ods, unsigned char* buf) {
+    size_t offset = 0;
+
+    offset += sup_put_u16(buf + offset, ods->obj_id);
+    offset += sup_put_u8(buf + offset, ods->obj_version);
+    offset += sup_put_u8(buf + offset, ods->obj_flag);
+
+    if (ods->obj_flag & SUP_ODS_FIRST) {
+        offset += sup_put_u8(buf + offset, (ods->obj_data_len >> 16) & 0xff);
+        offset += sup_put_u16(buf + offset, ods->obj_data_len & 0xffff);
+        offset += sup_put_u16(buf + offset, ods->obj_width);
+        offset += sup_put_u16(buf + offset, ods->obj_height);
+    }
+
+    memcpy(buf + offset, ods->raw_data, ods->raw_data_len);
+    offset += ods->raw_data_len;
+
+    return offset;
+}
@@ -7,6 +7,7 @@
 
 #define SUP_PACKET_MARKER 0x5047  /* "PG" */
 #define SUP_PACKET_MAX_SEGMENT_LEN 0xffff
+#define SUP_PACKET_HEADER_LEN 13
 
 #define SUP_SEGMENT_PCS 0x16    /* Composition info */
 #define SUP_SEGMENT_PDS 0x14    /* Palette*/
@@ -38,6 +39,12 @@
 
 #define SUP_PTS_FREQ 90  /* 90 kHz */
 
+#define SUP_CHANNEL_GRAY 0  /* Y premultiplied by alpha */
+#define SUP_CHANNEL_Y 1
+#define SUP_CHANNEL_CR 2
+#define SUP_CHANNEL_CB 3
+#define SUP_CHANNEL_A 4
+
 
 struct sup_packet {
     uint16_t marker;          /* Packet marker: "PG" */
@@ -129,21 +136,31 @@ struct sup_segment_wds {
 
 
 float sup_frame_rate_by_id(uint8_t frame_rate_id);
+int sup_frame_rate_ratio(uint8_t frame_rate_id, unsigned int* num, unsigned int* den);
 unsigned long sup_pts_to_ms(uint32_t pts);
 
 int sup_init_packet(struct sup_packet* packet);
 int sup_read_packet(FILE* fd, struct sup_packet* packet);
+int sup_parse_packet_header(const unsigned char* buf, struct sup_packet* packet);
+void sup_serialize_packet_header(const struct sup_packet* packet, unsigned char* buf);
+int sup_write_packet(FILE* fd, const struct sup_packet* packet);
 
 int sup_init_segment_pcs(struct sup_segment_pcs* pcs);
 int sup_parse_segment_pcs(const struct sup_packet* packet, struct sup_segment_pcs* pcs);
+const struct sup_object* sup_find_object(const struct sup_segment_pcs* pcs, uint16_t obj_id);
+size_t sup_serialize_segment_pcs(const struct sup_segment_pcs* pcs, unsigned char* buf);
 
 int sup_init_segment_pds(struct sup_segment_pds* pds);
 int sup_parse_segment_pds(const struct sup_packet* packet, struct sup_segment_pds* pds);
+int sup_palette_lut(const struct sup_segment_pds* pds, int channel, uint8_t* lut);
+size_t sup_serialize_segment_pds(const struct sup_segment_pds* pds, unsigned char* buf);
 
 int sup_init_segment_wds(struct sup_segment_wds* wds);
 int sup_parse_segment_wds(const struct sup_packet* packet, struct sup_segment_wds* wds);
+size_t sup_serialize_segment_wds(const struct sup_segment_wds* wds, unsigned char* buf);
 
 int sup_init_segment_ods(struct sup_segment_ods* ods);
 int sup_parse_segment_ods(const struct sup_packet* packet, struct sup_segment_ods* ods);
+size_t sup_serialize_segment_ods(const struct sup_segment_ods* ods, unsigned char* buf);
 
 #endif  /* SUP2PGM_SUP_H */
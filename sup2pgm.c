@@ -7,17 +7,43 @@
  * All rights reserved.
  * Released under 3-clause BSD License.
  */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <errno.h>
+#include <unistd.h>
 
 #include "sup2pgm.h"
+#include "atlas.h"
+#include "cache.h"
+#include "canvas.h"
+#include "checkpoint.h"
+#include "cut.h"
+#include "decoder.h"
+#include "delta.h"
+#include "decompress.h"
+#include "follow.h"
+#include "lines.h"
+#include "mem.h"
 #include "srt.h"
 #include "pgm.h"
+#include "npy.h"
+#include "objects.h"
+#include "probe.h"
+#include "remux.h"
+#include "scale.h"
+#include "serve.h"
+#include "shm.h"
+#include "sink.h"
 #include "sup.h"
+#include "y4m.h"
 
 
 void print_usage_help(const char* bin) {
@@ -29,9 +55,32 @@ void print_usage_help(const char* bin) {
     printf("%s takes BD-SUP subtitle stream and dumps the captions as PGM images complete with SRT timecodes.\n\n", SUP2PGM_PROGRAM_NAME);
 
     printf("Options:\n");
-    printf("  -i <file_name>  Use file_name for input (default: stdin).\n");
+    printf("  -i <file_name>  Use file_name for input (default: stdin), gzip, xz or zstd compressed if built with support.\n");
     printf("  -o <base_name>  Use base_name for output files (default: movie_subtitle).\n");
     printf("  -v              Be verbose: dump parsed packets.\n");
+    printf("  --forced-only   Only extract captions with forced objects.\n");
+    printf("  --y4m           Write a YUV4MPEG2 stream (4:4:4 with alpha) to stdout instead of PGM images.\n");
+    printf("  --shm <name>    Publish captions to POSIX shared memory ring buffer name instead of PGM images.\n");
+    printf("  --remux <file>  Write an optimized SUP stream (cropped objects, merged palettes) to file instead of PGM images.\n");
+    printf("  --probe         Print a JSON summary of the input (captions, durations, sizes) instead of converting it.\n");
+    printf("  --cut <from>-<to>  Copy the input from the first epoch start at or after from up to the one at or after to into base_name.sup.\n");
+    printf("  --split <t>[,<t>...]  Split the input at the first epoch start at or after each time into base_name_partNNN.sup.\n");
+    printf("  --rebase        Shift PTS and DTS of --cut and --split parts to start at zero.\n");
+    printf("  --follow <sec>  Keep reading a SUP file that's still being written, stop after sec seconds without new data (0: never).\n");
+    printf("  --serve <path>  Run conversion jobs for clients of Unix socket path.\n");
+    printf("  --workers <n>   Run up to n jobs at a time with --serve (default: %d).\n", SERVE_DEFAULT_WORKERS);
+    printf("  --scale 1/<n>   Scale PGM images down n times.\n");
+    printf("  --height <n>    Scale PGM images down to n pixels high.\n");
+    printf("  --atlas <width> Pack captions cropped onto width by width PGM pages instead of an image each, placed in the SRTX.\n");
+    printf("  --npy <height>  Write captions cropped and scaled to height as NumPy arrays instead of PGM images.\n");
+    printf("  --objects       Write each composition object as an image of its own, placed in the SRTX.\n");
+    printf("  --low-latency   Write each caption as soon as it's read, its end time following once known.\n");
+    printf("  --delta         Write captions as patches over the last full image where only part of them changes, merging repeats.\n");
+    printf("  --lines <rows>  Write each text line as an image of its own, split at rows blank rows or more, placed in the SRTX.\n");
+    printf("  --cache <dir>   Reuse captions rendered by earlier runs, kept in dir.\n");
+    printf("  --cache-size <MB>  Evict least recently used captions from the cache past that size (default: %d).\n", CACHE_DEFAULT_SIZE_MB);
+    printf("  --checkpoint    Keep track of the progress in base_name.ckpt.\n");
+    printf("  --resume        Continue from base_name.ckpt, if any (implies --checkpoint).\n");
 }
 
 
@@ -135,129 +184,212 @@ void dump_segment_end(const struct sup_packet* packet) {
 }
 
 
-int render_sup_image(unsigned char* dest, size_t dest_len,
-                     const unsigned char* src, size_t src_len, uint16_t obj_id,
-                     const struct sup_segment_pcs* pcs,
-                     const struct sup_segment_wds* wds,
-                     const struct sup_segment_pds* pds,
-                     const struct sup_segment_ods* ods) {
+/**
+ * Writes the caption image, downscaled if there's a scaler.  With a cache,
+ * the image is linked to the cached one if it's there (cached), or added
+ * to the cache once written.
+ */
+int write_sup_image(size_t subtitle_num,
+                    const char* img_base_filename, char* img_filename_buf,
+                    const struct canvas* canvas, struct scaler* scaler,
+                    struct render_cache* cache, uint64_t cache_key, uint8_t cached) {
+    FILE* img_file;
+    int result;
 
-    size_t video_width = pcs->video_width,
-           video_height = pcs->video_height,
-           obj_pos_x = 0,
-           obj_pos_y = 0,
-           window_pos_x = 0,
-           window_pos_y = 0,
-           window_width = 0,
-           window_height = 0;
+    sprintf(img_filename_buf, "%s%05lu.pgm", img_base_filename, subtitle_num);
 
-    size_t src_idx, dest_idx, i, j, n;
+    if (cached) {
+        if (cache_link(cache, cache_key, img_filename_buf)) {
+            return -1;
+        }
+    } else {
+        if (canvas == NULL || canvas->live_cnt == 0) {
+            return -1;
+        }
 
-    unsigned char b;
+        /* The old image may be a link to a cache entry, don't write through it. */
+        if (cache != NULL) {
+            unlink(img_filename_buf);
+        }
 
-    for (i = 0; i < pcs->num_of_objects; i++) {
-        if (pcs->objects[i].obj_id == obj_id) {
-            obj_pos_x = pcs->objects[i].obj_pos_x;
-            obj_pos_y = pcs->objects[i].obj_pos_y;
-            for (j = 0; j < wds->num_of_windows; j++) {
-                if (wds->windows[j].win_id == pcs->objects[i].win_id) {
-                    window_pos_x = wds->windows[j].x;
-                    window_pos_y = wds->windows[j].y;
-                    window_width = wds->windows[j].width;
-                    window_height = wds->windows[j].height;
-                    break;
-                }
-            }
+        if ((img_file = fopen(img_filename_buf, "wb")) == NULL) {
+            perror("main(): fopen(PGM)");
+            return -1;
+        }
+        if (scaler != NULL) {
+            scaler_run(scaler, canvas);
+            result = pgm_write(img_file, scaler->img, scaler->width, scaler->height);
+        } else {
+            result = canvas_write_pgm(img_file, canvas);
+        }
+        if (fclose(img_file)) {
+            perror("main(): fclose(PGM)");
+            result = -1;
+        }
+        if (result) {
+            /* Nothing's to point at an empty or partial image. */
+            unlink(img_filename_buf);
+            return -1;
+        }
+
+        if (cache != NULL && cache_key != 0) {
+            cache_insert(cache, cache_key, img_filename_buf);
         }
     }
 
-    if (window_width == 0 ||
-        window_height == 0 ||
-        obj_pos_x < window_pos_x ||
-        obj_pos_y < window_pos_y) {
+    return 0;
+}
+
 
-        ERROR("SUP object or window not found.\n");
+/**
+ * Writes the caption image and its SRTX entry.
+ */
+int save_sup_image(FILE* srt_file,
+                   size_t subtitle_num,
+                   uint32_t start_time, uint32_t end_time, char* timecode_buf,
+                   const char* img_base_filename, char* img_filename_buf,
+                   const struct canvas* canvas, struct scaler* scaler,
+                   struct render_cache* cache, uint64_t cache_key, uint8_t cached) {
+    if (write_sup_image(subtitle_num, img_base_filename, img_filename_buf,
+                        canvas, scaler, cache, cache_key, cached)) {
         return -1;
     }
 
-    pgm_clear_region(dest, video_width, video_height,
-                     window_width, window_height,
-                     window_pos_x, window_pos_y);
+    DEBUG("Saving image %lu.\n\n", subtitle_num);
 
-    src_idx = 0;
-    dest_idx = obj_pos_y * video_width + obj_pos_x;
+    fprintf(srt_file, "%lu\n", subtitle_num + 1);
 
-    while (src_idx < src_len && dest_idx < dest_len) {
-        b = src[src_idx++];
-        if (b == 0x00) {
-            b = src[src_idx++];
-            if (b == 0x00) {
-                /* 00 00 eq. new line. */
-                obj_pos_y++;
-                dest_idx = obj_pos_y * video_width + obj_pos_x;
+    srt_render_time(start_time, timecode_buf);
+    fprintf(srt_file, "%s --> ", timecode_buf);
+    srt_render_time(end_time, timecode_buf);
+    fprintf(srt_file, "%s\n", timecode_buf);
 
-            } else {
-                if ((b & 0xc0) == 0x40) {
-                    /* 00 4x xx -> xxx zeroes. */
-                    n = ((b - 0x40) << 8) + src[src_idx++];
-                    for (i = 0; i < n; i++) {
-                        dest[dest_idx++] = 0x00;
-                    }
+    fprintf(srt_file, "%s\n", img_filename_buf);
+    fprintf(srt_file, "\n");
 
-                } else if ((b & 0xC0) == 0x80) {
-                    /* 00 8x yy -> x times value y. */
-                    n = (b - 0x80);
-                    b = pds->colors[src[src_idx++]].gray;
-                    for (i = 0; i < n; i++) {
-                        dest[dest_idx++] = b;
-                    }
+    return 0;
+}
 
-                } else if ((b & 0xc0) != 0) {
-                    /* 00 cx yy zz -> xyy times value z. */
-                    n = ((b - 0xc0) << 8) + src[src_idx++];
-                    b = pds->colors[src[src_idx++]].gray;
-                    for (i = 0; i < n; i++) {
-                        dest[dest_idx++] = b;
-                    }
-                } else {
-                    /* 00 xx -> xx times 0. */
-                    for (i = 0; i < b; i++) {
-                        dest[dest_idx++] = 0x00;
-                    }
-                }
-            }
-        } else {
-            b = pds->colors[b].gray;
-            dest[dest_idx++] = b;
-        }
+
+/**
+ * Packs the caption onto an atlas page and writes its SRTX entry:
+ * "page_image x y width height screen_x screen_y".
+ */
+int save_sup_atlas(FILE* srt_file,
+                   size_t subtitle_num,
+                   uint32_t start_time, uint32_t end_time, char* timecode_buf,
+                   struct atlas_writer* writer, const struct canvas* canvas) {
+    struct atlas_rect rect;
+
+    if (canvas == NULL || atlas_add(writer, canvas, &rect)) {
+        return -1;
     }
 
+    DEBUG("Packing caption %lu on page %lu.\n\n", subtitle_num, rect.page_num);
+
+    fprintf(srt_file, "%lu\n", subtitle_num + 1);
+
+    srt_render_time(start_time, timecode_buf);
+    fprintf(srt_file, "%s --> ", timecode_buf);
+    srt_render_time(end_time, timecode_buf);
+    fprintf(srt_file, "%s\n", timecode_buf);
+
+    fprintf(srt_file, "%s %lu %lu %lu %lu %lu %lu\n", atlas_page_filename(writer, rect.page_num),
+            rect.x, rect.y, rect.width, rect.height, rect.screen_x, rect.screen_y);
+    fprintf(srt_file, "\n");
+
     return 0;
 }
 
 
-int save_sup_image(FILE* srt_file,
-                   size_t subtitle_num,
-                   uint32_t start_time, uint32_t end_time, char* timecode_buf,
-                   const char* img_base_filename, char* img_filename_buf,
-                   const unsigned char* img, size_t img_width, size_t img_height) {
-    int result = -1;
-    FILE* img_file;
+/**
+ * Writes the SRTX entry of a caption whose end isn't known yet, with
+ * SUP2PGM_OPEN_END in place of the end time.  Returns the offset of the
+ * placeholder, -1 on failure.
+ */
+off_t open_sup_entry(FILE* srt_file,
+                     size_t subtitle_num, uint32_t start_time, char* timecode_buf,
+                     const char* img_filename) {
+    off_t offset;
+
+    fprintf(srt_file, "%lu\n", subtitle_num + 1);
+
+    srt_render_time(start_time, timecode_buf);
+    fprintf(srt_file, "%s --> ", timecode_buf);
+    offset = ftello(srt_file);
+    fprintf(srt_file, "%s\n", SUP2PGM_OPEN_END);
+
+    fprintf(srt_file, "%s\n", img_filename);
+    fprintf(srt_file, "\n");
 
-    if (img == NULL) {
-        return result;
+    if (fflush(srt_file) || offset < 0) {
+        perror("open_sup_entry(): fflush()");
+        return -1;
     }
 
-    sprintf(img_filename_buf, "%s%05lu.pgm", img_base_filename, subtitle_num);
-    if ((img_file = fopen(img_filename_buf, "wb")) == NULL) {
-        perror("main(): fopen(PGM)");
-        return result;
+    DEBUG("Image %lu written, end time to follow.\n\n", subtitle_num);
+    return offset;
+}
+
+
+/**
+ * Fills in the end time of the entry opened at offset.
+ */
+int close_sup_entry(FILE* srt_file, off_t offset, uint32_t end_time, char* timecode_buf) {
+    srt_render_time(end_time, timecode_buf);
+
+    if (fseeko(srt_file, offset, SEEK_SET) ||
+        fwrite(timecode_buf, SRT_TIMECODE_LEN, 1, srt_file) != 1 ||
+        fseeko(srt_file, 0, SEEK_END) ||
+        fflush(srt_file)) {
+        perror("close_sup_entry()");
+        return -1;
     }
 
-    if (!pgm_write(img_file, img, img_width, img_height)) {
-        result = 0;
+    return 0;
+}
 
-        DEBUG("Saving image %lu.\n\n", subtitle_num);
+
+/**
+ * Takes back the entry that starts at entry_offset, its image and all, once
+ * the caption turns out to be blank after all, or it's dropped by an epoch
+ * start.
+ */
+int retract_sup_entry(FILE* srt_file, off_t entry_offset, const char* img_filename) {
+    unlink(img_filename);
+
+    if (fflush(srt_file) ||
+        ftruncate(fileno(srt_file), entry_offset) ||
+        fseeko(srt_file, entry_offset, SEEK_SET)) {
+        perror("retract_sup_entry()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Writes the SRTX entry of a caption made of separate object images:
+ * one "image x y window_x window_y window_width window_height" line per
+ * visible object.  Objects seen before aren't written again.
+ */
+int save_sup_objects(FILE* srt_file,
+                     size_t subtitle_num,
+                     uint32_t start_time, uint32_t end_time, char* timecode_buf,
+                     struct object_store* store, const struct sup_decoder* dec) {
+    size_t nums[DECODER_MAX_ENTRIES];
+    const struct sink_object* obj;
+    size_t i, visible = 0;
+
+    for (i = 0; i < store->refs_cnt; i++) {
+        if ((nums[i] = objects_write(store, dec, i)) != OBJECTS_INVISIBLE) {
+            visible++;
+        }
+    }
+
+    if (visible > 0) {
+        DEBUG("Saving caption %lu, %lu object(s).\n\n", subtitle_num, visible);
 
         fprintf(srt_file, "%lu\n", subtitle_num + 1);
 
@@ -266,211 +398,1219 @@ int save_sup_image(FILE* srt_file,
         srt_render_time(end_time, timecode_buf);
         fprintf(srt_file, "%s\n", timecode_buf);
 
-        fprintf(srt_file, "%s\n", img_filename_buf);
+        for (i = 0; i < store->refs_cnt; i++) {
+            if (nums[i] == OBJECTS_INVISIBLE) {
+                continue;
+            }
+            obj = &(store->refs[i].placement);
+            fprintf(srt_file, "%s %lu %lu %lu %lu %lu %lu\n", objects_filename(store, nums[i]),
+                    obj->x, obj->y,
+                    obj->window_x, obj->window_y, obj->window_width, obj->window_height);
+        }
         fprintf(srt_file, "\n");
     }
 
-    fclose(img_file);
-    return result;
+    return visible > 0 ? 0 : -1;
 }
 
 
-int main(int argc, char* argv[]) {
-    size_t i = 0;
+/**
+ * Writes the SRTX entry of a caption split into text lines: one
+ * "image x y width height" line per text line, top to bottom.
+ */
+int save_sup_lines(FILE* srt_file,
+                   size_t subtitle_num,
+                   uint32_t start_time, uint32_t end_time, char* timecode_buf,
+                   struct line_splitter* splitter, const struct canvas* canvas) {
+    const struct line_box* box;
+    const char* filename;
+    size_t i, written = 0;
 
-    uint8_t verbose = 0;
+    if (canvas == NULL || canvas->live_cnt == 0 || lines_find(splitter, canvas) == 0) {
+        return -1;
+    }
 
-    FILE* sup_file = stdin;
-    char* sup_filename = NULL;
+    DEBUG("Saving caption %lu, %lu line(s).\n\n", subtitle_num, splitter->lines_cnt);
 
-    FILE* srt_file = NULL;
-    char* srt_filename = NULL;
-    uint32_t srt_start_time = 0,
-             srt_end_time = 0;
-    char* srt_timecode = NULL;
+    fprintf(srt_file, "%lu\n", subtitle_num + 1);
 
-    size_t pgm_file_num = 0;
-    char* pgm_base_filename = "movie_subtitle";
-    char* pgm_filename = NULL;
+    srt_render_time(start_time, timecode_buf);
+    fprintf(srt_file, "%s --> ", timecode_buf);
+    srt_render_time(end_time, timecode_buf);
+    fprintf(srt_file, "%s\n", timecode_buf);
 
-    unsigned char* canvas = NULL;
-    size_t canvas_len = 0,
-           canvas_width = 0,
-           canvas_height = 0;
+    for (i = 0; i < splitter->lines_cnt; i++) {
+        if ((filename = lines_write(splitter, canvas, subtitle_num, i)) == NULL) {
+            continue;
+        }
+        box = &(splitter->lines[i]);
+        fprintf(srt_file, "%s %lu %lu %lu %lu\n", filename,
+                box->x, box->y, box->width, box->height);
+        written++;
+    }
+    fprintf(srt_file, "\n");
 
-    size_t subimgs_cnt = 0;
-    struct subimage** subimgs;
-    struct subimage* subimg = NULL;
+    return written > 0 ? 0 : -1;
+}
 
-    size_t packet_num = 0;
-    struct sup_packet* packet = NULL;
-    struct sup_segment_pcs* pcs = NULL;
-    struct sup_segment_pds* pds = NULL;
-    struct sup_segment_wds* wds = NULL;
-    struct sup_segment_ods* ods = NULL;
 
-    for (i = 1; i < argc; i++) {
-        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "-?")) {
-            print_usage_help(argv[0]);
-            return EXIT_SUCCESS;
-        } else if (!strcmp(argv[i], "-v")) {
-            verbose = 1;
-        } else if (!strcmp(argv[i], "-i")) {
-            i++;
-            if (i == argc || strlen(argv[i]) == 0) {
-                ERROR("Please specify an input file.\n");
-                return EXIT_FAILURE;
-            } else {
-                sup_filename = argv[i];
-            }
-        } else if (!strcmp(argv[i], "-o")) {
-            i++;
-            if (i == argc || strlen(argv[i]) == 0) {
-                ERROR("Please specify the base name for PGM images.\n");
-                return EXIT_FAILURE;
-            } else {
-                pgm_base_filename = argv[i];
-            }
-        }
+/**
+ * Writes the SRTX entry of a delta caption: "image" for a keyframe,
+ * "image x y width height base_image" for a patch over one.
+ */
+void print_delta_entry(FILE* srt_file, const struct delta_entry* entry,
+                       struct delta_writer* writer, char* timecode_buf) {
+    fprintf(srt_file, "%lu\n", entry->num + 1);
+
+    srt_render_time(entry->start_time, timecode_buf);
+    fprintf(srt_file, "%s --> ", timecode_buf);
+    srt_render_time(entry->end_time, timecode_buf);
+    fprintf(srt_file, "%s\n", timecode_buf);
+
+    fprintf(srt_file, "%s", delta_filename(writer, entry->num));
+    if (entry->base_num != DELTA_NONE) {
+        fprintf(srt_file, " %lu %lu %lu %lu", entry->x, entry->y, entry->width, entry->height);
+        fprintf(srt_file, " %s", delta_filename(writer, entry->base_num));
     }
+    fprintf(srt_file, "\n\n");
+}
 
-    if (sup_filename != NULL) {
-        if ((sup_file = fopen(sup_filename, "rb")) == NULL) {
-            ERROR("Failed opening SUP file %s.\n", sup_filename);
-            return EXIT_FAILURE;
-        }
+
+/**
+ * Hands the caption to the delta writer, writing out the SRTX entry it's
+ * done with.  Returns -1 unless the caption got an image of its own.
+ */
+int save_sup_delta(FILE* srt_file,
+                   size_t subtitle_num,
+                   uint32_t start_time, uint32_t end_time, char* timecode_buf,
+                   struct delta_writer* writer, const struct canvas* canvas) {
+    struct delta_entry done;
+    int result;
+
+    if (canvas == NULL) {
+        return -1;
     }
 
-    pgm_filename = calloc(strlen(pgm_base_filename) + 10, sizeof(char));
-    if (pgm_filename == NULL) {
-        perror("main(): calloc(PGM_FILENAME)");
-        fclose(sup_file);
-        return EXIT_FAILURE;
+    result = delta_add(writer, canvas, subtitle_num, start_time, end_time, &done);
+    if (done.num != DELTA_NONE) {
+        print_delta_entry(srt_file, &done, writer, timecode_buf);
     }
 
-    srt_filename = calloc(strlen(pgm_base_filename) + 6, sizeof(char));
-    if (srt_filename == NULL) {
-        perror("main(): calloc(SRT_FILENAME)");
-        fclose(sup_file);
-        return EXIT_FAILURE;
-    } else {
-        sprintf(srt_filename, "%s.srtx", pgm_base_filename);
+    if (result == DELTA_EXTENDED) {
+        DEBUG("Extending image %lu.\n\n", writer->pending.num);
+    } else if (result == DELTA_WRITTEN) {
+        DEBUG("Saving image %lu.\n\n", subtitle_num);
     }
-    if ((srt_file = fopen(srt_filename, "w")) == NULL) {
-        ERROR("Failed opening SRT file %s.\n", srt_filename);
-        free(srt_filename);
-        fclose(sup_file);
-        return EXIT_FAILURE;
+
+    return result == DELTA_WRITTEN ? 0 : -1;
+}
+
+
+/**
+ * Tells from the RLE data and the palette whether anything of the
+ * composition would show up in gray, before rendering any of it.
+ */
+int composition_visible(const struct sup_decoder* dec, uint8_t forced_only) {
+    const struct sup_segment_pcs* pcs = dec->pcs;
+    struct subimage* subimg;
+    uint8_t lut[0x100];
+    size_t i;
+
+    if (sup_palette_lut(dec->pds, SUP_CHANNEL_GRAY, lut)) {
+        return 1;
     }
-    srt_timecode = calloc(SRT_TIMECODE_LEN + 1, sizeof(char));
-    if (srt_timecode == NULL) {
-        perror("main(): calloc(SRT_TIMESTAMP)");
-        free(srt_filename);
-        fclose(srt_file);
-        fclose(sup_file);
-        return EXIT_FAILURE;
+
+    for (i = 0; i < pcs->num_of_objects; i++) {
+        if (forced_only && !(pcs->objects[i].obj_flag & SUP_PCS_OBJ_FORCED)) {
+            continue;
+        }
+
+        subimg = decoder_find_object(dec, pcs->objects[i].obj_id);
+        if (subimg != NULL && sink_rle_visible(subimg->img, subimg->len, lut)) {
+            return 1;
+        }
     }
 
-    subimgs = NULL;
+    return 0;
+}
+
 
-    packet = calloc(1, sizeof(struct sup_packet));
-    pcs = calloc(1, sizeof(struct sup_segment_pcs));
-    pds = calloc(1, sizeof(struct sup_segment_pds));
-    wds = calloc(1, sizeof(struct sup_segment_wds));
-    ods = calloc(1, sizeof(struct sup_segment_ods));
-    if (sup_init_packet(packet) ||
-        sup_init_segment_pcs(pcs) ||
-        sup_init_segment_pds(pds) ||
-        sup_init_segment_wds(wds) ||
-        sup_init_segment_ods(ods)) {
+/**
+ * Composition put off until it's saved: its palette and where its objects
+ * go.  The object data stays with the decoder, which keeps it at least
+ * until the next composition's PCS, when it's either saved or dropped.
+ */
+struct deferred_composition {
+    uint8_t pending;
+    struct sup_segment_pcs pcs;  /* Header only, objects are in placements */
+    struct sup_segment_pds pds;
+    struct sup_color colors[DECODER_MAX_ENTRIES];
+    struct sink_object placements[DECODER_MAX_ENTRIES];
+    size_t placements_cnt;
+};
 
-        ERROR("SUP placeholders' initialization failed.\n");
 
-        free(ods);
-        if (wds != NULL) {
-            free(wds->windows);
-            free(wds);
-        }
-        if (pds != NULL) {
-            free(pds->colors);
-            free(pds);
+/**
+ * Takes note of the decoder's composition to be rendered later.
+ */
+void defer_composition(struct deferred_composition* deferred,
+                       const struct sup_decoder* dec, uint8_t forced_only) {
+    const struct sup_segment_pcs* pcs = dec->pcs;
+    struct sink_object* obj;
+    size_t i;
+
+    deferred->pcs = *pcs;
+    deferred->pcs.num_of_objects = 0;
+    deferred->pcs.objects = NULL;
+
+    deferred->pds = *(dec->pds);
+    deferred->pds.colors = deferred->colors;
+    memcpy(deferred->colors, dec->pds->colors, dec->pds->num_of_colors * sizeof(struct sup_color));
+
+    deferred->placements_cnt = 0;
+    for (i = 0; i < pcs->num_of_objects; i++) {
+        if (forced_only && !(pcs->objects[i].obj_flag & SUP_PCS_OBJ_FORCED)) {
+            continue;
         }
-        if (pcs != NULL) {
-            free(pcs->objects);
-            free(pcs);
+        if (decoder_find_object(dec, pcs->objects[i].obj_id) == NULL) {
+            continue;
         }
-        if (packet != NULL) {
-            free(packet->segment);
-            free(packet);
+
+        obj = &(deferred->placements[deferred->placements_cnt]);
+        if (sink_find_object(obj, pcs->objects[i].obj_id, pcs, dec->wds)) {
+            ERROR("SUP object or window not found.\n");
+            continue;
         }
+        deferred->placements_cnt++;
+    }
 
-        free(srt_timecode);
-        free(srt_filename);
+    deferred->pending = 1;
+}
 
-        fclose(srt_file);
-        fclose(sup_file);
 
-        return EXIT_FAILURE;
+/**
+ * Renders the composition put off, marking its rows for the line splitter
+ * if there's one.  Sets forced if any of the objects rendered is.
+ */
+void render_composition(struct deferred_composition* deferred, const struct sup_decoder* dec,
+                        struct sink* sink, struct line_splitter* lines, uint8_t* forced) {
+    const struct sink_object* obj;
+    struct subimage* subimg;
+    size_t i;
+
+    sink->ops->begin_caption(sink, &(deferred->pcs), &(deferred->pds));
+    if (lines != NULL) {
+        lines_set_palette(lines, &(deferred->pds));
     }
 
-    for (; !feof(sup_file); packet_num++) {
-        if (sup_read_packet(sup_file, packet)) {
+    for (i = 0; i < deferred->placements_cnt; i++) {
+        obj = &(deferred->placements[i]);
+        if ((subimg = decoder_find_object(dec, obj->obj_id)) == NULL) {
             continue;
         }
 
-        if (packet->segment_type == SUP_SEGMENT_PCS) {
-            /* Set up composition. */
-            if (sup_parse_segment_pcs(packet, pcs)) {
-                ERROR("Bad PCS %lu.\n", packet_num);
-                continue;
-            } else if (verbose) {
-                dump_segment_pcs(pcs);
+        if (!sink->ops->render_object(sink, obj, subimg->img, subimg->len)) {
+            *forced |= obj->obj_flag & SUP_PCS_OBJ_FORCED;
+            if (lines != NULL) {
+                lines_add_object(lines, subimg, obj);
             }
+        }
+    }
 
-            if (pcs->comp_state == SUP_PCS_STATE_EPOCH_START) {
-                /**
-                 * Start a new composition: clear the image buffer,
-                 * reset the timecodes.
-                 */
-                if (canvas_width != pcs->video_width || canvas_height != pcs->video_height) {
-                    if (canvas != NULL) {
-                        free(canvas);
-                    }
+    sink->ops->end_caption(sink);
+    deferred->pending = 0;
+}
 
-                    canvas_width = pcs->video_width;
-                    canvas_height = pcs->video_height;
-                    canvas_len = canvas_width * canvas_height;
-                    if ((canvas = malloc(canvas_len)) == NULL) {
-                        perror("main(): malloc(CANVAS)");
-                        break;
-                    }
-                }
 
-                srt_start_time = pcs->pts_msec;
-                srt_end_time = 0;
+/**
+ * Hashes whatever rendering the composition depends on: canvas and output
+ * size, palette, object placement and data.  Sets forced if any of the
+ * objects rendered is.
+ */
+uint64_t hash_composition(const struct sup_decoder* dec, const struct canvas* canvas,
+                          size_t width, size_t height,
+                          uint8_t forced_only, uint8_t* forced) {
+    const struct sup_segment_pcs* pcs = dec->pcs;
+    const struct sup_segment_pds* pds = dec->pds;
+    struct sink_object sink_obj;
+    struct subimage* subimg;
+    uint64_t hash;
+    size_t geometry[6];
+    uint8_t color[5];
+    size_t i;
 
-            } else if (pcs->pts_msec >= srt_start_time + SUP2PGM_MERGE_THRESHOLD) {
-                /* Save the previously rendered composition. */
-                srt_end_time = pcs->pts_msec;
+    hash = cache_hash(0, CACHE_FORMAT, strlen(CACHE_FORMAT));
 
-                if (!save_sup_image(srt_file,
-                                    pgm_file_num,
-                                    srt_start_time, srt_end_time, srt_timecode,
-                                    pgm_base_filename, pgm_filename,
-                                    canvas, canvas_width, canvas_height)) {
-                    pgm_file_num++;
-                }
+    geometry[0] = canvas->width;
+    geometry[1] = canvas->height;
+    geometry[2] = width;
+    geometry[3] = height;
+    hash = cache_hash(hash, geometry, 4 * sizeof(size_t));
 
-                srt_start_time = pcs->pts_msec;
-                srt_end_time = 0;
-            }
+    for (i = 0; i < pds->num_of_colors; i++) {
+        /* The same colors under other indices render differently. */
+        color[0] = pds->colors[i].idx;
+        color[1] = pds->colors[i].y;
+        color[2] = pds->colors[i].cr;
+        color[3] = pds->colors[i].cb;
+        color[4] = pds->colors[i].a;
+        hash = cache_hash(hash, color, sizeof(color));
+    }
 
-            pgm_clear(canvas, canvas_width, canvas_height);
+    *forced = 0;
+    for (i = 0; i < pcs->num_of_objects; i++) {
+        if (forced_only && !(pcs->objects[i].obj_flag & SUP_PCS_OBJ_FORCED)) {
+            continue;
+        }
 
-        } else if (packet->segment_type == SUP_SEGMENT_PDS) {
-            /* Extract palette. */
-            if (sup_parse_segment_pds(packet, pds)) {
+        subimg = decoder_find_object(dec, pcs->objects[i].obj_id);
+        if (subimg == NULL ||
+            sink_find_object(&sink_obj, pcs->objects[i].obj_id, pcs, dec->wds)) {
+            continue;
+        }
+
+        geometry[0] = sink_obj.x;
+        geometry[1] = sink_obj.y;
+        geometry[2] = sink_obj.window_x;
+        geometry[3] = sink_obj.window_y;
+        geometry[4] = sink_obj.window_width;
+        geometry[5] = sink_obj.window_height;
+        hash = cache_hash(hash, geometry, sizeof(geometry));
+        hash = cache_hash(hash, subimg->img, subimg->len);
+
+        *forced |= sink_obj.obj_flag & SUP_PCS_OBJ_FORCED;
+    }
+
+    return hash;
+}
+
+
+int publish_sup_image(struct shm_ring* ring,
+                      size_t subtitle_num,
+                      uint32_t start_time, uint32_t end_time,
+                      const struct canvas* canvas) {
+    struct shm_caption caption;
+    unsigned char* img;
+
+    if (canvas == NULL || canvas_max_gray(canvas) == 0x00) {
+        return -1;
+    }
+
+    memset(&caption, 0x00, sizeof(struct shm_caption));
+    caption.subtitle_num = subtitle_num + 1;
+    caption.start_ms = start_time;
+    caption.end_ms = end_time;
+    caption.width = canvas->width;
+    caption.height = canvas->height;
+
+    if ((img = shm_ring_begin(ring, &caption)) == NULL) {
+        return -1;
+    }
+    canvas_copy(canvas, img);
+    shm_ring_commit(ring);
+
+    DEBUG("Published image %lu.\n\n", subtitle_num);
+    return 0;
+}
+
+
+/**
+ * Cuts one part, "from-to" (either may be left out), into base_name.sup or
+ * splits the whole input at "t,t,..." into base_name_partNNN.sup, every
+ * time moved forward to the next epoch start.  Empty parts aren't written.
+ */
+int cut_sup(int fd, const char* base_filename, const char* cut_range, const char* split_times,
+            uint8_t rebase) {
+    struct sup_cutter cutter;
+    uint32_t points[CUT_MAX_POINTS];
+    size_t points_cnt = 0, part_num, parts_cnt = 0;
+    const char* p;
+    char* end;
+    char* filename;
+    char timecode[SRT_TIMECODE_LEN + 1];
+    const struct cut_part* part;
+    int result = 0;
+
+    if (cut_range != NULL) {
+        /* Part 1 of "from" or "from,to", part 0 is what comes before. */
+        points[0] = 0;
+        end = (char*) cut_range;
+        if ((*end != '-' && cut_parse_time(end, &end, &(points[0]))) || *end != '-') {
+            ERROR("Please specify the part to cut as [HH:MM:SS.mmm]-[HH:MM:SS.mmm].\n");
+            return -1;
+        }
+        points_cnt = 1;
+        if (*(++end) != '\0') {
+            if (cut_parse_time(end, &end, &(points[1])) || *end != '\0') {
+                ERROR("Please specify the part to cut as [HH:MM:SS.mmm]-[HH:MM:SS.mmm].\n");
+                return -1;
+            }
+            points_cnt = 2;
+        }
+    } else {
+        for (p = split_times; ; p = end + 1) {
+            if (points_cnt == CUT_MAX_POINTS || cut_parse_time(p, &end, &(points[points_cnt])) ||
+                (*end != ',' && *end != '\0')) {
+                ERROR("Please specify up to %d times to split at as HH:MM:SS.mmm,...\n", CUT_MAX_POINTS);
+                return -1;
+            }
+            points_cnt++;
+            if (*end == '\0') {
+                break;
+            }
+        }
+    }
+
+    if (cut_open(&cutter, fd, points, points_cnt, rebase)) {
+        return -1;
+    }
+    if (cut_scan(&cutter)) {
+        cut_close(&cutter);
+        return -1;
+    }
+
+    /* "<base>_part<number>.sup" */
+    if ((filename = mem_alloc(strlen(base_filename) + 30)) == NULL) {
+        perror("cut_sup(): malloc()");
+        cut_close(&cutter);
+        return -1;
+    }
+
+    for (part_num = cut_range != NULL ? 1 : 0; part_num <= points_cnt; part_num++) {
+        part = &(cutter.parts[part_num]);
+        if (part->end == part->start) {
+            continue;
+        }
+
+        if (cut_range != NULL) {
+            sprintf(filename, "%s.sup", base_filename);
+        } else {
+            sprintf(filename, "%s_part%03lu.sup", base_filename, parts_cnt + 1);
+        }
+        if (cut_write_part(&cutter, part_num, filename)) {
+            ERROR("Failed writing SUP file %s.\n", filename);
+            result = -1;
+            break;
+        }
+        parts_cnt++;
+
+        srt_render_time(part->pts / SUP_PTS_FREQ, timecode);
+        DEBUG("%s: %lld bytes from %s.\n", filename, (long long) (part->end - part->start), timecode);
+
+        if (cut_range != NULL) {
+            break;
+        }
+    }
+
+    if (result == 0 && parts_cnt == 0) {
+        ERROR("No epoch starts within the part to cut.\n");
+        result = -1;
+    }
+    DEBUG("%lu packets scanned, %lu epochs, %lu part(s) written, %llu bytes copied by %s.\n",
+          cutter.packets, cutter.epochs, parts_cnt, cutter.bytes_out,
+          cut_copy_method_name(cutter.copy_method));
+
+    free(filename);
+    cut_close(&cutter);
+    return result;
+}
+
+
+/**
+ * Runs one conversion as told by the command line.  The decoder and the
+ * canvas are set up by the caller and may be reused for the next one.
+ * input, if not NULL, is read unless there's -i, and closed either way.
+ */
+int convert(int argc, char* argv[], FILE* input,
+            struct sup_decoder* dec, struct canvas* canvas) {
+    int result = EXIT_SUCCESS;
+    size_t i = 0;
+
+    size_t scale_den = 1,
+           scale_height = 0,
+           scaled_width,
+           scaled_height;
+    struct scaler scaler;
+
+    char* cache_dir = NULL;
+    unsigned long long cache_size_mb = CACHE_DEFAULT_SIZE_MB;
+    struct render_cache cache;
+    uint64_t cache_key = 0;
+    uint8_t cache_hit = 0,
+            cache_forced = 0,
+            cache_ready = 0;
+
+    uint8_t verbose = 0;
+    uint8_t forced_only = 0;
+
+    FILE* sup_file = input;
+    FILE* raw_file;
+    char* sup_filename = NULL;
+    int compression = DECOMPRESS_NONE;
+
+    uint8_t follow_mode = 0,
+            follow_opened = 0;
+    unsigned long follow_timeout = 0;
+    char* end;
+    struct follow_reader follow;
+
+    uint8_t checkpointing = 0,
+            resume = 0,
+            ckpt_dirty = 0;
+    char* ckpt_filename = NULL;
+    int ckpt_found = 1;  /* 0: read, 1: none yet, -1: unreadable */
+    struct checkpoint ckpt;
+    struct timespec ckpt_time, now;
+
+    FILE* srt_file = NULL;
+    char* srt_filename = NULL;
+    uint32_t srt_start_time = 0,
+             srt_end_time = 0;
+    char* srt_timecode = NULL;
+
+    size_t pgm_file_num = 0;
+    char* pgm_base_filename = "movie_subtitle";
+    char* pgm_filename = NULL;
+
+    uint8_t canvas_forced = 0,
+            canvas_blank = 0;
+    size_t blank_cnt = 0;
+
+    uint8_t objects_mode = 0;
+
+    struct deferred_composition deferred;
+    uint8_t lazy = 0;
+    size_t lazy_skipped = 0;
+
+    uint8_t low_latency = 0;
+    off_t open_entry = -1,
+          open_end = -1;
+
+    uint8_t delta_mode = 0;
+    struct delta_writer delta;
+    struct delta_entry delta_done;
+
+    size_t lines_gap = 0;
+    struct line_splitter lines;
+
+    size_t atlas_width = 0;
+    struct atlas_writer atlas;
+
+    size_t npy_height = 0;
+    struct npy_writer npy;
+
+    uint8_t probe_mode = 0;
+    struct probe_summary probe;
+
+    const char* cut_range = NULL;
+    const char* split_times = NULL;
+    uint8_t rebase = 0;
+    struct object_store objects;
+
+    struct sink* sink = NULL;
+    struct sink_gray gray_sink;
+    struct sink_y4m y4m_sink;
+    struct sink_object sink_obj;
+
+    uint8_t y4m_mode = 0;
+    FILE* y4m_file = NULL;
+    struct y4m_stream y4m;
+    unsigned int fps_num, fps_den;
+
+    char* shm_name = NULL;
+    struct shm_ring shm;
+
+    char* remux_filename = NULL;
+    FILE* remux_file = NULL;
+    struct remux remux;
+    uint8_t remux_ready = 0;
+
+    struct subimage* subimg = NULL;
+
+    size_t packet_num = 0;
+    unsigned long warm_allocs = 0;
+    struct sup_packet* packet = NULL;
+    struct sup_segment_pcs* pcs = NULL;
+    struct sup_segment_pds* pds = NULL;
+    struct sup_segment_wds* wds = NULL;
+    struct sup_segment_ods* ods = NULL;
+
+    /* Every way out goes through cleanup, input included. */
+    scaler_init(&scaler);
+    y4m.frame = NULL;
+    y4m.fd = NULL;
+    shm.hdr = NULL;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "-?")) {
+            print_usage_help(argv[0]);
+            goto cleanup;
+        } else if (!strcmp(argv[i], "-v")) {
+            verbose = 1;
+        } else if (!strcmp(argv[i], "--forced-only")) {
+            forced_only = 1;
+        } else if (!strcmp(argv[i], "--y4m")) {
+            y4m_mode = 1;
+        } else if (!strcmp(argv[i], "--shm")) {
+            i++;
+            if (i == argc || strlen(argv[i]) == 0) {
+                ERROR("Please specify the shared memory object name.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            } else {
+                shm_name = argv[i];
+            }
+        } else if (!strcmp(argv[i], "--follow")) {
+            i++;
+            if (i == argc || !isdigit((unsigned char) argv[i][0]) ||
+                (follow_timeout = strtoul(argv[i], &end, 10)) > ULONG_MAX / 1000 || *end != '\0') {
+                ERROR("Please specify the idle timeout in seconds.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            } else {
+                follow_mode = 1;
+            }
+        } else if (!strcmp(argv[i], "--scale")) {
+            i++;
+            if (i == argc || sscanf(argv[i], "1/%lu", &scale_den) != 1 || scale_den == 0) {
+                ERROR("Please specify the scale as 1/n.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            }
+        } else if (!strcmp(argv[i], "--height")) {
+            i++;
+            if (i == argc || (scale_height = strtoul(argv[i], NULL, 10)) == 0) {
+                ERROR("Please specify the image height.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            }
+        } else if (!strcmp(argv[i], "--probe")) {
+            probe_mode = 1;
+        } else if (!strcmp(argv[i], "--cut")) {
+            i++;
+            if (i == argc || strlen(argv[i]) == 0) {
+                ERROR("Please specify the part to cut as from-to.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            } else {
+                cut_range = argv[i];
+            }
+        } else if (!strcmp(argv[i], "--split")) {
+            i++;
+            if (i == argc || strlen(argv[i]) == 0) {
+                ERROR("Please specify the times to split at.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            } else {
+                split_times = argv[i];
+            }
+        } else if (!strcmp(argv[i], "--rebase")) {
+            rebase = 1;
+        } else if (!strcmp(argv[i], "--atlas")) {
+            i++;
+            if (i == argc || (atlas_width = strtoul(argv[i], NULL, 10)) < ATLAS_MIN_WIDTH) {
+                ERROR("Please specify the page width, %d or more.\n", ATLAS_MIN_WIDTH);
+                result = EXIT_FAILURE;
+                goto cleanup;
+            }
+        } else if (!strcmp(argv[i], "--npy")) {
+            i++;
+            if (i == argc || (npy_height = strtoul(argv[i], NULL, 10)) == 0) {
+                ERROR("Please specify the caption height.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            }
+        } else if (!strcmp(argv[i], "--objects")) {
+            objects_mode = 1;
+        } else if (!strcmp(argv[i], "--low-latency")) {
+            low_latency = 1;
+        } else if (!strcmp(argv[i], "--delta")) {
+            delta_mode = 1;
+        } else if (!strcmp(argv[i], "--lines")) {
+            i++;
+            if (i == argc || (lines_gap = strtoul(argv[i], NULL, 10)) == 0) {
+                ERROR("Please specify the number of blank rows between lines.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            }
+        } else if (!strcmp(argv[i], "--cache")) {
+            i++;
+            if (i == argc || strlen(argv[i]) == 0) {
+                ERROR("Please specify the cache directory.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            } else {
+                cache_dir = argv[i];
+            }
+        } else if (!strcmp(argv[i], "--cache-size")) {
+            i++;
+            if (i == argc || (cache_size_mb = strtoull(argv[i], NULL, 10)) == 0) {
+                ERROR("Please specify the cache size in MB.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            }
+        } else if (!strcmp(argv[i], "--checkpoint")) {
+            checkpointing = 1;
+        } else if (!strcmp(argv[i], "--resume")) {
+            checkpointing = 1;
+            resume = 1;
+        } else if (!strcmp(argv[i], "--remux")) {
+            i++;
+            if (i == argc || strlen(argv[i]) == 0) {
+                ERROR("Please specify an output SUP file.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            } else {
+                remux_filename = argv[i];
+            }
+        } else if (!strcmp(argv[i], "-i")) {
+            i++;
+            if (i == argc || strlen(argv[i]) == 0) {
+                ERROR("Please specify an input file.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            } else {
+                sup_filename = argv[i];
+            }
+        } else if (!strcmp(argv[i], "-o")) {
+            i++;
+            if (i == argc || strlen(argv[i]) == 0) {
+                ERROR("Please specify the base name for PGM images.\n");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            } else {
+                pgm_base_filename = argv[i];
+            }
+        }
+    }
+
+    if (checkpointing && (y4m_mode || shm_name != NULL || remux_filename != NULL)) {
+        ERROR("Checkpoints are only kept for PGM output.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if ((scale_den > 1 || scale_height > 0) && (y4m_mode || shm_name != NULL || remux_filename != NULL)) {
+        ERROR("Only PGM images can be scaled.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (cache_dir != NULL && (y4m_mode || shm_name != NULL || remux_filename != NULL)) {
+        ERROR("The cache only holds PGM output.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (objects_mode && (y4m_mode || shm_name != NULL || remux_filename != NULL ||
+                         cache_dir != NULL || scale_den > 1 || scale_height > 0 || checkpointing)) {
+        ERROR("Object images can't be combined with other outputs, scaling, cache or checkpoints.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (npy_height > 0 && (y4m_mode || shm_name != NULL || remux_filename != NULL || objects_mode ||
+                           cache_dir != NULL || scale_den > 1 || scale_height > 0 || checkpointing)) {
+        ERROR("NumPy arrays can't be combined with other outputs, scaling, cache or checkpoints.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (lines_gap > 0 && (y4m_mode || shm_name != NULL || remux_filename != NULL || objects_mode ||
+                          npy_height > 0 || cache_dir != NULL || scale_den > 1 || scale_height > 0)) {
+        ERROR("Line images can't be combined with other outputs, scaling or cache.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (delta_mode && (y4m_mode || shm_name != NULL || remux_filename != NULL || objects_mode ||
+                       npy_height > 0 || lines_gap > 0 ||
+                       cache_dir != NULL || scale_den > 1 || scale_height > 0 || checkpointing)) {
+        ERROR("Delta output can't be combined with other outputs, scaling, cache or checkpoints.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (low_latency && (y4m_mode || shm_name != NULL || remux_filename != NULL || objects_mode ||
+                        npy_height > 0 || lines_gap > 0 || delta_mode)) {
+        ERROR("Low latency output is only there for PGM images.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (atlas_width > 0 && (y4m_mode || shm_name != NULL || remux_filename != NULL || objects_mode ||
+                            npy_height > 0 || lines_gap > 0 || delta_mode || low_latency ||
+                            cache_dir != NULL || scale_den > 1 || scale_height > 0 || checkpointing)) {
+        ERROR("Atlas pages can't be combined with other outputs, scaling, cache or checkpoints.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if ((cut_range != NULL || split_times != NULL) &&
+        ((cut_range != NULL && split_times != NULL) || probe_mode || follow_mode ||
+         y4m_mode || shm_name != NULL || remux_filename != NULL || objects_mode ||
+         npy_height > 0 || lines_gap > 0 || delta_mode || low_latency || atlas_width > 0 ||
+         cache_dir != NULL || scale_den > 1 || scale_height > 0 || checkpointing)) {
+        ERROR("Cutting and splitting can't be combined with each other or anything else.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (rebase && cut_range == NULL && split_times == NULL) {
+        ERROR("Only --cut and --split parts can be rebased.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (cache_dir != NULL && cache_open(&cache, cache_dir, cache_size_mb * 1024 * 1024)) {
+        ERROR("Failed opening cache %s.\n", cache_dir);
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    cache_ready = cache_dir != NULL;
+
+    if (sup_filename != NULL) {
+        if (sup_file != NULL) {
+            /* -i takes the place of the stream passed in. */
+            fclose(sup_file);
+        }
+        if ((sup_file = fopen(sup_filename, "rb")) == NULL) {
+            ERROR("Failed opening SUP file %s.\n", sup_filename);
+            result = EXIT_FAILURE;
+            goto cleanup;
+        }
+    } else if (sup_file == NULL) {
+        ERROR("Please specify an input file.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    /* The follower reads the file descriptor itself, so no peeking there. */
+    if (!follow_mode) {
+        raw_file = sup_file;
+        if ((sup_file = decompress_open(raw_file, &compression)) == NULL) {
+            ERROR("Failed opening SUP input.\n");
+            fclose(raw_file);
+            result = EXIT_FAILURE;
+            goto cleanup;
+        }
+        if (compression != DECOMPRESS_NONE && checkpointing) {
+            ERROR("Can't keep checkpoints of %s compressed input.\n",
+                  decompress_format_name(compression));
+            result = EXIT_FAILURE;
+            goto cleanup;
+        }
+    }
+
+    if (probe_mode) {
+        if (probe_run(sup_file, dec, strlen(pgm_base_filename), &probe)) {
+            ERROR("Failed probing SUP input.\n");
+            result = EXIT_FAILURE;
+        } else {
+            probe_print_json(stdout, &probe);
+        }
+        goto cleanup;
+    }
+
+    if (cut_range != NULL || split_times != NULL) {
+        if (compression != DECOMPRESS_NONE) {
+            ERROR("Can't cut %s compressed input.\n", decompress_format_name(compression));
+            result = EXIT_FAILURE;
+        } else if (cut_sup(fileno(sup_file), pgm_base_filename, cut_range, split_times, rebase)) {
+            ERROR("Failed cutting SUP input.\n");
+            result = EXIT_FAILURE;
+        }
+        goto cleanup;
+    }
+
+    if (checkpointing) {
+        ckpt_filename = mem_calloc(strlen(pgm_base_filename) + 6, sizeof(char));
+        if (ckpt_filename == NULL) {
+            perror("main(): calloc(CKPT_FILENAME)");
+            result = EXIT_FAILURE;
+            goto cleanup;
+        }
+        sprintf(ckpt_filename, "%s.ckpt", pgm_base_filename);
+        clock_gettime(CLOCK_MONOTONIC, &ckpt_time);
+
+        if (resume) {
+            ckpt_found = checkpoint_read(ckpt_filename, &ckpt);
+        }
+        if (ckpt_found < 0) {
+            /* Starting over would wipe what there is to resume. */
+            ERROR("Failed reading checkpoint %s.\n", ckpt_filename);
+            result = EXIT_FAILURE;
+            goto cleanup;
+        } else if (ckpt_found == 0) {
+            /* Whatever follows the epoch start is rendered again. */
+            if (fseeko(sup_file, ckpt.offset, SEEK_SET)) {
+                perror("main(): fseeko(SUP)");
+                result = EXIT_FAILURE;
+                goto cleanup;
+            }
+            pgm_file_num = ckpt.pgm_file_num;
+            srt_start_time = ckpt.srt_start_time;
+            DEBUG("Resuming at offset %lld, image %lu.\n",
+                  (long long) ckpt.offset, pgm_file_num);
+        } else {
+            resume = 0;
+        }
+    }
+
+    if (follow_mode) {
+        if (follow_open(&follow, fileno(sup_file), sup_filename, follow_timeout * 1000)) {
+            ERROR("Failed following SUP input.\n");
+            result = EXIT_FAILURE;
+            goto cleanup;
+        }
+        follow_opened = 1;
+    }
+
+    if (y4m_mode) {
+        /* Keep the stream to ourselves, send the chatter to stderr. */
+        fflush(stdout);
+        if ((y4m_file = fdopen(dup(STDOUT_FILENO), "wb")) == NULL ||
+            dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            perror("main(): dup(STDOUT)");
+            result = EXIT_FAILURE;
+            goto cleanup;
+        }
+    }
+
+    if (shm_name != NULL && shm_ring_create(&shm, shm_name, SHM_RING_DEFAULT_SIZE)) {
+        ERROR("Failed creating ring buffer %s.\n", shm_name);
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    if (remux_filename != NULL) {
+        if ((remux_file = fopen(remux_filename, "wb")) == NULL) {
+            ERROR("Failed opening SUP file %s.\n", remux_filename);
+            result = EXIT_FAILURE;
+            goto cleanup;
+        }
+        if (remux_init(&remux, remux_file)) {
+            ERROR("Re-muxer initialization failed.\n");
+            result = EXIT_FAILURE;
+            goto cleanup;
+        }
+        remux_ready = 1;
+    }
+
+    pgm_filename = mem_calloc(strlen(pgm_base_filename) + 10, sizeof(char));
+    if (pgm_filename == NULL) {
+        perror("main(): calloc(PGM_FILENAME)");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    srt_filename = mem_calloc(strlen(pgm_base_filename) + 6, sizeof(char));
+    if (srt_filename == NULL) {
+        perror("main(): calloc(SRT_FILENAME)");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    } else {
+        sprintf(srt_filename, "%s.srtx", pgm_base_filename);
+    }
+    if (!y4m_mode && shm_name == NULL && remux_file == NULL && npy_height == 0 &&
+        (srt_file = fopen(srt_filename, resume ? "r+" : "w")) == NULL) {
+        ERROR("Failed opening SRT file %s.\n", srt_filename);
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if (resume && (ftruncate(fileno(srt_file), ckpt.srt_len) ||
+                   fseeko(srt_file, ckpt.srt_len, SEEK_SET))) {
+        perror("main(): ftruncate(SRT)");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+    if ((follow_mode || low_latency) && srt_file != NULL) {
+        /* Make each caption visible as soon as it's saved. */
+        setvbuf(srt_file, NULL, _IOLBF, 0);
+    }
+    srt_timecode = mem_calloc(SRT_TIMECODE_LEN + 1, sizeof(char));
+    if (srt_timecode == NULL) {
+        perror("main(): calloc(SRT_TIMESTAMP)");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    /**
+     * The writers below are mutually exclusive and the last to be set up,
+     * so a failing one leaves none of them to be closed.
+     */
+    if (npy_height > 0 && npy_open(&npy, pgm_base_filename, npy_height)) {
+        ERROR("Failed creating NumPy arrays.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    if (atlas_width > 0 && atlas_open(&atlas, pgm_base_filename, atlas_width)) {
+        ERROR("Failed setting up atlas pages.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    if (objects_mode && objects_init(&objects, pgm_base_filename)) {
+        ERROR("Object store initialization failed.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    if (lines_gap > 0 && lines_init(&lines, pgm_base_filename, lines_gap)) {
+        ERROR("Line splitter initialization failed.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    if (delta_mode && delta_init(&delta, pgm_base_filename)) {
+        ERROR("Delta writer initialization failed.\n");
+        result = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    /**
+     * Only render what gets saved, unless each composition is shown
+     * (Y4M) or written (low latency) as soon as it's complete.
+     */
+    lazy = !y4m_mode && !low_latency;
+    deferred.pending = 0;
+
+    /* Nothing from the previous conversion carries over. */
+    decoder_reset_objects(dec);
+    decoder_reset_composition(dec);
+
+    packet = dec->packet;
+    pcs = dec->pcs;
+    pds = dec->pds;
+    wds = dec->wds;
+    ods = dec->ods;
+
+    for (; follow_mode ? !follow.done : !feof(sup_file) && !ferror(sup_file); packet_num++) {
+        if (follow_mode ? follow_read_packet(&follow, packet) : sup_read_packet(sup_file, packet)) {
+            if (follow_mode ? follow.error : !feof(sup_file)) {
+                /* Bad or unreadable input, anything but the end of it. */
+                result = EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        if (remux_file != NULL) {
+            /* The re-muxer parses packets itself, one epoch at a time. */
+            if (remux_add_packet(&remux, packet)) {
+                ERROR("Failed re-muxing packet %lu.\n", packet_num);
+                result = EXIT_FAILURE;
+                break;
+            }
+            continue;
+        }
+
+        if (packet->segment_type == SUP_SEGMENT_PCS) {
+            /* Set up composition. */
+            if (sup_parse_segment_pcs(packet, pcs)) {
+                ERROR("Bad PCS %lu.\n", packet_num);
+                result = EXIT_FAILURE;
+                continue;
+            } else if (verbose) {
+                dump_segment_pcs(pcs);
+            }
+
+            if (pcs->comp_state == SUP_PCS_STATE_EPOCH_START) {
+                /* Objects are only valid within their epoch. */
+                decoder_reset_objects(dec);
+            }
+
+            if (y4m_mode) {
+                /* Show the previous composition up to this one, frame by frame. */
+                if (y4m.frame == NULL) {
+                    if (sup_frame_rate_ratio(pcs->frame_rate, &fps_num, &fps_den)) {
+                        ERROR("Unknown frame rate 0x%02x.\n", pcs->frame_rate);
+                        result = EXIT_FAILURE;
+                        break;
+                    }
+                    if (y4m_open(&y4m, y4m_file,
+                                 pcs->video_width, pcs->video_height,
+                                 fps_num, fps_den)) {
+                        ERROR("Failed starting Y4M stream.\n");
+                        result = EXIT_FAILURE;
+                        break;
+                    }
+                    sink_y4m_init(&y4m_sink, &y4m);
+                    sink = &(y4m_sink.base);
+                } else if (y4m.width != pcs->video_width || y4m.height != pcs->video_height) {
+                    ERROR("Video size changed in PCS %lu, Y4M stream can't follow.\n", packet_num);
+                    result = EXIT_FAILURE;
+                    break;
+                }
+
+                if (y4m_write_until(&y4m, pcs->pts_msec)) {
+                    result = EXIT_FAILURE;
+                    break;
+                }
+
+                y4m_clear(&y4m);
+                continue;
+            }
+
+            if (open_end >= 0 && pcs->comp_state == SUP_PCS_STATE_EPOCH_START) {
+                /* An epoch start drops what's on screen unsaved, as without --low-latency. */
+                sprintf(pgm_filename, "%s%05lu.pgm", pgm_base_filename, pgm_file_num);
+                retract_sup_entry(srt_file, open_entry, pgm_filename);
+                open_entry = -1;
+                open_end = -1;
+            } else if (open_end >= 0 && pcs->pts_msec >= srt_start_time + SUP2PGM_MERGE_THRESHOLD) {
+                /* The caption written at END is over. */
+                if (!close_sup_entry(srt_file, open_end, pcs->pts_msec, srt_timecode)) {
+                    pgm_file_num++;
+                }
+                open_entry = -1;
+                open_end = -1;
+            }
+
+            if (pcs->comp_state == SUP_PCS_STATE_EPOCH_START && checkpointing) {
+                /* Nothing before an epoch start is needed to go on from there. */
+                ckpt.offset = (follow_mode ? follow.offset : ftello(sup_file)) -
+                              SUP_PACKET_HEADER_LEN - packet->segment_len;
+                ckpt.pgm_file_num = pgm_file_num;
+                ckpt.srt_start_time = srt_start_time;
+                ckpt.srt_len = ftello(srt_file);
+                ckpt_dirty = ckpt.offset >= 0 && ckpt.srt_len >= 0;
+
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (ckpt_dirty &&
+                    (now.tv_sec - ckpt_time.tv_sec) * 1000 +
+                    (now.tv_nsec - ckpt_time.tv_nsec) / 1000000 >= CHECKPOINT_INTERVAL_MS) {
+                    fflush(srt_file);
+                    if (!checkpoint_write(ckpt_filename, &ckpt)) {
+                        ckpt_dirty = 0;
+                    }
+                    ckpt_time = now;
+                }
+            }
+
+            if (pcs->comp_state == SUP_PCS_STATE_EPOCH_START) {
+                /**
+                 * Start a new composition: clear the image buffer,
+                 * reset the timecodes.
+                 */
+                if (canvas->width != pcs->video_width || canvas->height != pcs->video_height) {
+                    if (canvas_resize(canvas, pcs->video_width, pcs->video_height)) {
+                        result = EXIT_FAILURE;
+                        break;
+                    }
+                    /* The sink clips to the size it was set up with. */
+                    sink = NULL;
+                }
+                if (lines_gap > 0 && lines_resize(&lines, canvas->height)) {
+                    result = EXIT_FAILURE;
+                    break;
+                }
+                if (sink == NULL) {
+                    sink_gray_init(&gray_sink, canvas);
+                    sink = &(gray_sink.base);
+                }
+
+                if ((scale_den > 1 || scale_height > 0) &&
+                    (scaler.src_width != canvas->width || scaler.src_height != canvas->height)) {
+                    if (scale_height > 0) {
+                        scaled_width = (canvas->width * scale_height + canvas->height / 2) / canvas->height;
+                        scaled_height = scale_height;
+                    } else {
+                        scaled_width = (canvas->width + scale_den - 1) / scale_den;
+                        scaled_height = (canvas->height + scale_den - 1) / scale_den;
+                    }
+                    if (scaler_resize(&scaler, canvas->width, canvas->height, scaled_width, scaled_height)) {
+                        ERROR("Can't scale %lux%lu down to %lux%lu.\n",
+                              canvas->width, canvas->height, scaled_width, scaled_height);
+                        result = EXIT_FAILURE;
+                        break;
+                    }
+                }
+
+                srt_start_time = pcs->pts_msec;
+                srt_end_time = 0;
+
+            } else if (pcs->pts_msec >= srt_start_time + SUP2PGM_MERGE_THRESHOLD) {
+                /* Save the previous composition, rendering it now if it was put off. */
+                srt_end_time = pcs->pts_msec;
+                if (deferred.pending) {
+                    render_composition(&deferred, dec, sink, lines_gap > 0 ? &lines : NULL,
+                                       &canvas_forced);
+                }
+
+                if (forced_only && !canvas_forced) {
+                    /* Nothing worth saving. */
+                } else if (low_latency) {
+                    /* Saved at END already. */
+                } else if (shm_name != NULL) {
+                    if (!publish_sup_image(&shm,
+                                           pgm_file_num,
+                                           srt_start_time, srt_end_time,
+                                           canvas)) {
+                        pgm_file_num++;
+                    } else if (shm.abandoned) {
+                        ERROR("Nobody's reading ring buffer %s, giving up.\n", shm_name);
+                        result = EXIT_FAILURE;
+                        break;
+                    }
+                } else if (npy_height > 0) {
+                    if (!npy_add(&npy, canvas, pgm_file_num, srt_start_time, srt_end_time)) {
+                        pgm_file_num++;
+                    }
+                } else if (objects_mode) {
+                    if (!save_sup_objects(srt_file,
+                                          pgm_file_num,
+                                          srt_start_time, srt_end_time, srt_timecode,
+                                          &objects, dec)) {
+                        pgm_file_num++;
+                    }
+                } else if (atlas_width > 0) {
+                    if (!save_sup_atlas(srt_file,
+                                        pgm_file_num,
+                                        srt_start_time, srt_end_time, srt_timecode,
+                                        &atlas, canvas)) {
+                        pgm_file_num++;
+                    }
+                } else if (delta_mode) {
+                    if (!save_sup_delta(srt_file,
+                                        pgm_file_num,
+                                        srt_start_time, srt_end_time, srt_timecode,
+                                        &delta, canvas)) {
+                        pgm_file_num++;
+                    }
+                } else if (lines_gap > 0) {
+                    if (!save_sup_lines(srt_file,
+                                        pgm_file_num,
+                                        srt_start_time, srt_end_time, srt_timecode,
+                                        &lines, canvas)) {
+                        pgm_file_num++;
+                    }
+                } else if (!save_sup_image(srt_file,
+                                           pgm_file_num,
+                                           srt_start_time, srt_end_time, srt_timecode,
+                                           pgm_base_filename, pgm_filename,
+                                           canvas, scaler.img != NULL ? &scaler : NULL,
+                                           cache_dir != NULL ? &cache : NULL, cache_key, cache_hit)) {
+                    pgm_file_num++;
+                }
+                if (warm_allocs == 0) {
+                    warm_allocs = mem_allocs();
+                }
+
+                srt_start_time = pcs->pts_msec;
+                srt_end_time = 0;
+            }
+
+            if (deferred.pending) {
+                /* Superseded or never saved, so never rendered. */
+                lazy_skipped++;
+                deferred.pending = 0;
+            }
+            canvas_clear(canvas);
+            canvas_forced = 0;
+            cache_key = 0;
+            cache_hit = 0;
+            if (objects_mode) {
+                objects_clear(&objects);
+            }
+            if (lines_gap > 0) {
+                lines_clear(&lines);
+            }
+
+        } else if (packet->segment_type == SUP_SEGMENT_PDS) {
+            /* Extract palette. */
+            if (sup_parse_segment_pds(packet, pds)) {
                 ERROR("Bad PDS %lu.\n", packet_num);
+                result = EXIT_FAILURE;
                 continue;
             } else if (verbose) {
                 dump_segment_pds(pds);
@@ -480,6 +1620,7 @@ int main(int argc, char* argv[]) {
             /* Extract windows info. */
             if (sup_parse_segment_wds(packet, wds)) {
                 ERROR("Bad WDS %lu.\n", packet_num);
+                result = EXIT_FAILURE;
                 continue;
             } else if (verbose) {
                 dump_segment_wds(wds);
@@ -489,115 +1630,297 @@ int main(int argc, char* argv[]) {
             /* Decode and render caption image. */
             if (sup_parse_segment_ods(packet, ods)) {
                 ERROR("Bad ODS %lu.\n", packet_num);
+                result = EXIT_FAILURE;
                 continue;
             } else if (verbose) {
                 dump_segment_ods(ods);
             }
 
-            if (subimgs_cnt < ods->obj_id + 1) {
-                subimgs = realloc(subimgs, (ods->obj_id + 1) * sizeof(struct subimage*));
-                if (subimgs == NULL) {
-                    perror("main(): realloc(SUBIMGS)");
-                    break;
-                } else {
-                    for (i = subimgs_cnt; i <= ods->obj_id; i++) {
-                        subimgs[i] = malloc(sizeof(struct subimage));
-                        if (subimgs[i] == NULL) {
-                            perror("main(): malloc(SUBIMG)");
-                        } else {
-                            subimgs[i]->max_len = 0;
-                            subimgs[i]->len = 0;
-                            subimgs[i]->img = NULL;
-                        }
-                    }
-                    subimgs_cnt = ods->obj_id + 1;
-                }
-            }
-
-            subimg = subimgs[ods->obj_id];
-            if (subimg == NULL) {
-                break;
+            /**
+             * Kept even if this composition doesn't show it forced: a later
+             * one within the epoch may, without sending it again.
+             */
+            if (decoder_add_ods(dec, ods)) {
+                ERROR("Failed storing ODS %lu.\n", packet_num);
+                result = EXIT_FAILURE;
+                continue;
             }
 
-            if (subimg->img == NULL) {
-                subimg->max_len = SUP_PACKET_MAX_SEGMENT_LEN;
-                if ((subimg->img = malloc(subimg->max_len)) == NULL) {
-                    perror("main(): malloc(SUBIMG)");
-                    break;
-                }
-            }
+        } else if (packet->segment_type == SUP_SEGMENT_END) {
+            /* Render composition. */
 
-            if (ods->obj_flag & SUP_ODS_FIRST) {
-                subimg->len = 0;
+            if (verbose) {
+                dump_segment_end(packet);
             }
 
-            if (subimg->len + ods->raw_data_len > subimg->max_len) {
-                subimg->max_len = subimg->len + ods->raw_data_len;
-                if ((subimg->img = realloc(subimg->img, subimg->max_len)) == NULL) {
-                    perror("main(): realloc(SUBIMG)");
-                    break;
+            /**
+             * Clearing the screen?  Then there's nothing to render, hash or
+             * save, the canvas was cleared at the PCS already.  Not so for
+             * Y4M, where black can be opaque.
+             */
+            canvas_blank = !y4m_mode && sink != NULL && pcs->num_of_objects > 0 &&
+                           !composition_visible(dec, forced_only);
+            if (canvas_blank) {
+                blank_cnt++;
+            } else if (cache_dir != NULL && sink != NULL && pcs->num_of_objects > 0) {
+                /* Rendered before?  Then there's no need to. */
+                cache_key = hash_composition(dec, canvas,
+                                             scaler.img != NULL ? scaler.width : canvas->width,
+                                             scaler.img != NULL ? scaler.height : canvas->height,
+                                             forced_only, &cache_forced);
+                if (!cache_lookup(&cache, cache_key)) {
+                    cache_hit = 1;
+                    canvas_forced |= cache_forced;
                 }
             }
 
-            memcpy(subimg->img + subimg->len, ods->raw_data, ods->raw_data_len);
-            subimg->len += ods->raw_data_len;
+            if (canvas_blank) {
+                /* Nothing to do. */
+            } else if (objects_mode && sink != NULL && pcs->num_of_objects > 0) {
+                /* Only take note of the objects, they're decoded when saved. */
+                objects_set_palette(&objects, pds);
+                for (i = 0; i < pcs->num_of_objects; i++) {
+                    if (forced_only && !(pcs->objects[i].obj_flag & SUP_PCS_OBJ_FORCED)) {
+                        continue;
+                    }
 
-        } else if (packet->segment_type == SUP_SEGMENT_END) {
-            /* Render composition. */
+                    subimg = decoder_find_object(dec, pcs->objects[i].obj_id);
+                    if (subimg == NULL) {
+                        continue;
+                    }
+                    if (sink_find_object(&sink_obj, pcs->objects[i].obj_id, pcs, wds)) {
+                        ERROR("SUP object or window not found.\n");
+                        continue;
+                    }
 
-            if (verbose) {
-                dump_segment_end(packet);
+                    if (!objects_add(&objects, subimg, &sink_obj)) {
+                        canvas_forced |= sink_obj.obj_flag & SUP_PCS_OBJ_FORCED;
+                    }
+                }
+            } else if (sink != NULL && pcs->num_of_objects > 0 && !cache_hit) {
+                defer_composition(&deferred, dec, forced_only);
+                if (!lazy) {
+                    render_composition(&deferred, dec, sink, lines_gap > 0 ? &lines : NULL,
+                                       &canvas_forced);
+                }
             }
 
-            if (pcs->num_of_objects > 0) {
-                for (i = 0; i < pcs->num_of_objects; i++) {
-                    if (pcs->objects[i].obj_id < subimgs_cnt) {
-                        subimg = subimgs[pcs->objects[i].obj_id];
-                        render_sup_image(canvas, canvas_len,
-                                         subimg->img, subimg->len, pcs->objects[i].obj_id,
-                                         pcs, wds, pds, ods);
+            if (low_latency && sink != NULL) {
+                /**
+                 * Write the caption right away, again if it's changed
+                 * within the merge threshold, under the same number.
+                 */
+                if ((!forced_only || canvas_forced) &&
+                    (cache_hit || canvas_max_gray(canvas) != 0x00) &&
+                    !write_sup_image(pgm_file_num, pgm_base_filename, pgm_filename,
+                                     canvas, scaler.img != NULL ? &scaler : NULL,
+                                     cache_dir != NULL ? &cache : NULL, cache_key, cache_hit)) {
+                    if (open_end < 0) {
+                        open_entry = ftello(srt_file);
+                        open_end = open_sup_entry(srt_file, pgm_file_num, srt_start_time,
+                                                  srt_timecode, pgm_filename);
                     }
+                } else if (open_end >= 0) {
+                    /* Cleared before it was due to be saved, it doesn't count. */
+                    sprintf(pgm_filename, "%s%05lu.pgm", pgm_base_filename, pgm_file_num);
+                    retract_sup_entry(srt_file, open_entry, pgm_filename);
+                    open_entry = -1;
+                    open_end = -1;
                 }
             }
 
             /* Reset composition placeholders. */
-            sup_init_segment_pcs(pcs);
-            sup_init_segment_pds(pds);
-            sup_init_segment_wds(wds);
-            sup_init_segment_ods(ods);
+            decoder_reset_composition(dec);
+
+            /**
+             * Whatever gets allocated past the first display set is a leak
+             * into the steady state; one put off is counted once saved.
+             */
+            if (warm_allocs == 0 && !deferred.pending) {
+                warm_allocs = mem_allocs();
+            }
         } else {
             ERROR("Unknown segment type 0x%02x for packet %lu.\n",
                   packet->segment_type, packet_num);
         }
     }
 
-    DEBUG("%lu packets parsed, %lu images saved.\n", packet_num, pgm_file_num);
+    if (open_end >= 0) {
+        /* Never ended, so it's not saved, same as without --low-latency. */
+        sprintf(pgm_filename, "%s%05lu.pgm", pgm_base_filename, pgm_file_num);
+        retract_sup_entry(srt_file, open_entry, pgm_filename);
+    }
+
+    if (y4m_mode) {
+        if (y4m.frame != NULL) {
+            /* Make sure the last composition makes it to at least one frame. */
+            y4m_write_frames(&y4m, 1);
+            DEBUG("%lu packets parsed, %lu frames written.\n", packet_num, y4m.frames);
+        }
+    } else if (remux_file != NULL) {
+        if (remux_finish(&remux)) {
+            ERROR("Failed writing SUP file %s.\n", remux_filename);
+            result = EXIT_FAILURE;
+        }
+        DEBUG("%lu packets parsed, %lu of %lu display sets written, %llu of %llu bytes.\n",
+              packet_num, remux.sets_out, remux.sets_in, remux.bytes_out, remux.bytes_in);
+    } else if (npy_height > 0) {
+        DEBUG("%lu packets parsed, %lu captions saved.\n", packet_num, pgm_file_num);
+        if (npy_close(&npy)) {
+            result = EXIT_FAILURE;
+        }
+    } else if (objects_mode) {
+        DEBUG("%lu packets parsed, %lu captions saved, %lu object images.\n",
+              packet_num, pgm_file_num, objects.files_cnt);
+        objects_free(&objects);
+    } else if (atlas_width > 0) {
+        if (atlas_close(&atlas)) {
+            result = EXIT_FAILURE;
+        }
+        DEBUG("%lu packets parsed, %lu captions saved on %lu page(s).\n",
+              packet_num, pgm_file_num, atlas.pages_cnt);
+    } else if (delta_mode) {
+        if (!delta_finish(&delta, &delta_done)) {
+            print_delta_entry(srt_file, &delta_done, &delta, srt_timecode);
+        }
+        DEBUG("%lu packets parsed, %lu images saved: %lu keyframe(s), %lu patch(es), %lu caption(s) merged.\n",
+              packet_num, pgm_file_num, delta.keyframes, delta.patches, delta.extended);
+        delta_free(&delta);
+    } else if (lines_gap > 0) {
+        DEBUG("%lu packets parsed, %lu captions saved.\n", packet_num, pgm_file_num);
+        lines_free(&lines);
+    } else {
+        DEBUG("%lu packets parsed, %lu images saved.\n", packet_num, pgm_file_num);
+    }
+
+    if (cache_dir != NULL) {
+        DEBUG("Cache: %lu hit(s), %lu miss(es), %.1f%% hit rate, %lu evicted, %llu MB.\n",
+              cache.hits, cache.misses,
+              cache.hits + cache.misses > 0 ? 100.0 * cache.hits / (cache.hits + cache.misses) : 0.0,
+              cache.evicted, cache.size / (1024 * 1024));
+    }
 
-    free(ods);
-    free(wds->windows);
-    free(wds);
-    free(pds->colors);
-    free(pds);
-    free(pcs->objects);
-    free(pcs);
-    free(packet->segment);
-    free(packet);
+    if (ckpt_dirty) {
+        fflush(srt_file);
+        checkpoint_write(ckpt_filename, &ckpt);
+    }
 
-    for (i = 0; i < subimgs_cnt; i++) {
-        free(subimgs[i]->img);
-        free(subimgs[i]);
+    if (verbose) {
+        DEBUG("%lu blank composition(s) skipped before rendering.\n", blank_cnt);
+        DEBUG("%lu composition(s) superseded before they were due to be rendered.\n", lazy_skipped);
+        DEBUG("%lu heap allocations, %lu after the first display set.\n",
+              mem_allocs(), warm_allocs > 0 ? mem_allocs() - warm_allocs : 0);
     }
-    free(subimgs);
 
-    free(canvas);
+cleanup:
+    /* Serve workers run one job after another, nothing may be left behind. */
+    if (y4m_file != NULL) {
+        y4m_close(&y4m);
+        fclose(y4m_file);
+    }
+    if (remux_ready) {
+        remux_free(&remux);
+    }
+    if (remux_file != NULL) {
+        fclose(remux_file);
+    }
+    scaler_free(&scaler);
+
+    if (cache_ready) {
+        cache_close(&cache);
+    }
+    free(ckpt_filename);
+
+    if (shm.hdr != NULL) {
+        shm_ring_finish(&shm);
+        shm_ring_close(&shm);
+    }
+
+    if (follow_opened) {
+        follow_close(&follow);
+    }
 
     free(pgm_filename);
 
     free(srt_timecode);
     free(srt_filename);
-    fclose(srt_file);
+    if (srt_file != NULL) {
+        fclose(srt_file);
+    }
+
+    if (sup_file != NULL) {
+        fclose(sup_file);
+    }
+
+    return result;
+}
+
+
+struct serve_ctx {
+    struct sup_decoder dec;
+    struct canvas canvas;
+};
+
+
+int serve_convert(int argc, char* argv[], FILE* input, void* ctx) {
+    struct serve_ctx* serve_ctx = ctx;
+    size_t i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--y4m") || !strcmp(argv[i], "--serve")) {
+            ERROR("%s isn't available to jobs.\n", argv[i]);
+            if (input != NULL) {
+                fclose(input);
+            }
+            return EXIT_FAILURE;
+        }
+    }
+
+    return convert(argc, argv, input, &(serve_ctx->dec), &(serve_ctx->canvas));
+}
+
+
+int main(int argc, char* argv[]) {
+    size_t i;
+    int result;
+
+    char* serve_path = NULL;
+    size_t serve_workers = SERVE_DEFAULT_WORKERS;
+    struct serve_ctx ctx;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--serve")) {
+            i++;
+            if (i == argc || strlen(argv[i]) == 0) {
+                ERROR("Please specify the socket path.\n");
+                return EXIT_FAILURE;
+            } else {
+                serve_path = argv[i];
+            }
+        } else if (!strcmp(argv[i], "--workers")) {
+            i++;
+            if (i == argc || (serve_workers = strtoul(argv[i], NULL, 10)) == 0) {
+                ERROR("Please specify the number of workers.\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
 
-    fclose(sup_file);
+    if (decoder_init(&(ctx.dec))) {
+        ERROR("SUP placeholders' initialization failed.\n");
+        return EXIT_FAILURE;
+    }
+    canvas_init(&(ctx.canvas));
+
+    if (serve_path != NULL) {
+        DEBUG("Serving on %s with %lu workers.\n", serve_path, serve_workers);
+        result = serve_run(serve_path, serve_workers, serve_convert, &ctx) ? EXIT_FAILURE : EXIT_SUCCESS;
+    } else {
+        result = convert(argc, argv, stdin, &(ctx.dec), &(ctx.canvas));
+    }
+
+    canvas_free(&(ctx.canvas));
+    decoder_free(&(ctx.dec));
 
-    return EXIT_SUCCESS;
+    return result;
 }
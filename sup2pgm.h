@@ -10,15 +10,11 @@
 /* Merge changes happening within 200 ms together. */
 #define SUP2PGM_MERGE_THRESHOLD 200
 
+/* End time of a caption still showing, as long as SRT_TIMECODE_LEN. */
+#define SUP2PGM_OPEN_END "--:--:--,---"
+
 #define DEBUG(...) fprintf(stdout, __VA_ARGS__)
 #define ERROR(...) fprintf(stderr, __VA_ARGS__)
 
 
-struct subimage {
-    size_t max_len;
-    size_t len;
-    unsigned char* img;
-};
-
-
 #endif  /* SUP2PGM_H */
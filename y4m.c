@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+#include "pgm.h"
+#include "y4m.h"
+
+#define Y4M_FRAME_MARKER "FRAME\n"
+#define Y4M_FRAME_MARKER_LEN 6
+
+
+int y4m_open(struct y4m_stream* y4m, FILE* fd,
+             size_t width, size_t height,
+             unsigned int fps_num, unsigned int fps_den) {
+    size_t i, plane_len = width * height;
+
+    if (y4m == NULL || fd == NULL || plane_len == 0 || fps_num == 0 || fps_den == 0) {
+        return -1;
+    }
+
+    y4m->fd = fd;
+    y4m->width = width;
+    y4m->height = height;
+    y4m->fps_num = fps_num;
+    y4m->fps_den = fps_den;
+    y4m->frames = 0;
+
+    y4m->frame_len = Y4M_FRAME_MARKER_LEN + Y4M_PLANES * plane_len;
+    if ((y4m->frame = mem_alloc(y4m->frame_len)) == NULL) {
+        perror("y4m_open(): malloc()");
+        return -1;
+    }
+
+    memcpy(y4m->frame, Y4M_FRAME_MARKER, Y4M_FRAME_MARKER_LEN);
+    for (i = 0; i < Y4M_PLANES; i++) {
+        y4m->planes[i] = y4m->frame + Y4M_FRAME_MARKER_LEN + i * plane_len;
+    }
+    y4m_clear(y4m);
+
+    if (fprintf(fd, "YUV4MPEG2 W%lu H%lu F%u:%u Ip A1:1 C444alpha\n",
+                width, height, fps_num, fps_den) < 0) {
+        perror("y4m_open(): fprintf()");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void y4m_clear(struct y4m_stream* y4m) {
+    size_t i;
+
+    for (i = 0; i < Y4M_PLANES; i++) {
+        pgm_clear(y4m->planes[i], y4m->width, y4m->height);
+    }
+}
+
+
+int y4m_write_frames(struct y4m_stream* y4m, unsigned long cnt) {
+    for (; cnt > 0; cnt--) {
+        if (fwrite(y4m->frame, y4m->frame_len, 1, y4m->fd) != 1) {
+            perror("y4m_write_frames(): fwrite()");
+            return -1;
+        }
+        y4m->frames++;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Repeats the current frame for every frame starting before ms.
+ */
+int y4m_write_until(struct y4m_stream* y4m, unsigned long ms) {
+    unsigned long long due;
+
+    due = ((unsigned long long) ms * y4m->fps_num + 1000ULL * y4m->fps_den - 1) /
+          (1000ULL * y4m->fps_den);
+
+    if (due <= y4m->frames) {
+        return 0;
+    }
+
+    return y4m_write_frames(y4m, due - y4m->frames);
+}
+
+
+void y4m_close(struct y4m_stream* y4m) {
+    if (y4m->fd != NULL) {
+        fflush(y4m->fd);
+    }
+
+    free(y4m->frame);
+    y4m->frame = NULL;
+    y4m->fd = NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef SUP2PGM_Y4M_H
+#define SUP2PGM_Y4M_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define Y4M_PLANE_Y 0
+#define Y4M_PLANE_CB 1
+#define Y4M_PLANE_CR 2
+#define Y4M_PLANE_A 3
+#define Y4M_PLANES 4
+
+
+/**
+ * YUV4MPEG2 stream of 4:4:4 frames with an alpha plane.  The frame is kept
+ * in one buffer, "FRAME\n" marker included, so that repeating it takes a
+ * single write.
+ */
+struct y4m_stream {
+    FILE* fd;
+    size_t width;
+    size_t height;
+    unsigned int fps_num;
+    unsigned int fps_den;
+
+    unsigned char* frame;
+    size_t frame_len;
+    unsigned char* planes[Y4M_PLANES];
+
+    unsigned long frames;
+};
+
+
+int y4m_open(struct y4m_stream* y4m, FILE* fd,
+             size_t width, size_t height,
+             unsigned int fps_num, unsigned int fps_den);
+void y4m_clear(struct y4m_stream* y4m);
+int y4m_write_frames(struct y4m_stream* y4m, unsigned long cnt);
+int y4m_write_until(struct y4m_stream* y4m, unsigned long ms);
+void y4m_close(struct y4m_stream* y4m);
+
+#endif  /* SUP2PGM_Y4M_H */